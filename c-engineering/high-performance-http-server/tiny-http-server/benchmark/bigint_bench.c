@@ -0,0 +1,93 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// times every big-integer multiplication at the top level across operand sizes, which is
+// where the thresholds in "libs/macros.h" come from, then F(n) for growing n without and
+// with the compute pool.
+//
+// usage: bigint-bench [compute_threads]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "libs/bigint.h"
+#include "libs/compute.h"
+#include "libs/macros.h"
+
+#define BENCH_SECONDS 0.3
+
+static volatile size_t sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the mean time of one "algo" product of two "limbs" long operands, in microseconds.
+static double timeMul(int algo, const uint32_t* a, const uint32_t* b, uint32_t* r, size_t limbs) {
+    size_t rounds = 0;
+    const double start = now();
+    double elapsed;
+    do {
+        bigMulWith(algo, r, a, limbs, b, limbs);
+        sink += r[limbs];
+        rounds++;
+    } while ((elapsed = now() - start) < BENCH_SECONDS);
+    return elapsed * 1e6 / rounds;
+}
+
+static double timeFib(long n) {
+    size_t rounds = 0, len;
+    const double start = now();
+    double elapsed;
+    do {
+        char* digits = bigFibDigits(n, &len);
+        sink += len;
+        free(digits);
+        rounds++;
+    } while ((elapsed = now() - start) < BENCH_SECONDS);
+    return elapsed * 1e3 / rounds;
+}
+
+int main(int argc, const char* argv[]) {
+    const int threads = argc > 1 ? atoi(argv[1]) : 4;
+    const size_t sizes[] = { 8, 16, 32, 64, 128, 200, 400, 1000, 2000, 4000, 16000, 64000 };
+    const size_t maxLimbs = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    uint32_t* a = malloc(maxLimbs * sizeof(uint32_t)), * b = malloc(maxLimbs * sizeof(uint32_t)),
+            * r = malloc(2 * maxLimbs * sizeof(uint32_t));
+    srand(7);
+    for (size_t i = 0; i < maxLimbs; i++) {
+        a[i] = rand() % BIG_BASE;
+        b[i] = rand() % BIG_BASE;
+    }
+
+    printf("%8s %12s %12s %12s %12s   (us per product, %d digits a limb)\n", "limbs", "schoolbook", "karatsuba",
+           "toom3", "ntt", BIG_BASE_DIGITS);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        printf("%8zu", sizes[i]);
+        for (int algo = BIG_MUL_SCHOOLBOOK; algo <= BIG_MUL_NTT; algo++) {
+            // the quadratic ones are left out where a single product takes seconds.
+            if ((algo == BIG_MUL_SCHOOLBOOK && sizes[i] > 16000) || (algo == BIG_MUL_KARATSUBA && sizes[i] > 64000))
+                printf(" %12s", "-");
+            else
+                printf(" %12.2f", timeMul(algo, a, b, r, sizes[i]));
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    const long nums[] = { 1000, 10000, 100000, 1000000, 10000000 };
+    printf("\n%10s %12s %12s   (ms per F(n), %d compute threads)\n", "n", "serial", "pooled", threads);
+    for (size_t i = 0; i < sizeof(nums) / sizeof(nums[0]); i++) {
+        computeInit(0);
+        const double serial = timeFib(nums[i]);
+        computeInit(threads);
+        printf("%10ld %12.3f %12.3f\n", nums[i], serial, timeFib(nums[i]));
+        fflush(stdout);
+    }
+    free(a);
+    free(b);
+    free(r);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// compares three ways of calling a running server for "num": a new connection per request
+// (what ad-hoc socket code does), libfibclient one call at a time over its keep-alive pool,
+// and libfibclient with every request submitted at once and pipelined over "connections"
+// connections "depth" deep. the target is a TCP port on 127.0.0.1 or "unix:/path". a last
+// pooled run asks for "large" (F(10^5) has 20899 digits), an answer well past the client's
+// initial receive buffer.
+//
+// usage: client-bench [port|unix:/path] [requests] [connections] [depth] [num] [large]
+//
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "client/fibclient.h"
+
+#define TIMEOUT_MS 5000
+#define LARGE_REQUESTS 100
+#define LARGE_DIGITS_CAP (4 << 20)
+
+static int answered, failed;
+
+static long nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int compareLong(const void* a, const void* b) {
+    const long x = *(const long*) a, y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char* name, int count, long elapsed, long* latencies) {
+    printf("%-12s %10.0f req/s", name, count * 1e9 / elapsed);
+    if (latencies != NULL) {
+        qsort(latencies, count, sizeof(long), compareLong);
+        printf("  p50 %7.1f us  p99 %7.1f us", latencies[count / 2] / 1e3, latencies[count * 99 / 100] / 1e3);
+    }
+    printf("  failed %d\n", failed);
+    failed = 0;
+}
+
+// the ad-hoc way: connect, write, read until the server closes.
+static int reconnectCall(const struct sockaddr* address, socklen_t addressLen, const char* request, size_t len) {
+    const int fd = socket(address->sa_family, SOCK_STREAM, 0);
+    const int on = 1;
+    if (address->sa_family == AF_INET)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (connect(fd, address, addressLen) < 0 || write(fd, request, len) != (ssize_t) len) {
+        close(fd);
+        return -1;
+    }
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0);
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+static void onAnswer(void* arg, int result, const char* digits, size_t len) {
+    (void) arg;
+    (void) digits;
+    (void) len;
+    if (result == FIB_OK)
+        answered++;
+    else
+        failed++;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* target = argc > 1 ? argv[1] : "8080";
+    const int count = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 20000;
+    const int connections = argc > 3 ? atoi(argv[3]) : 4;
+    const int depth = argc > 4 ? atoi(argv[4]) : 16;
+    const int num = argc > 5 ? atoi(argv[5]) : 20;
+    const int large = argc > 6 ? atoi(argv[6]) : 100000;
+
+    struct sockaddr_in inetAddress;
+    struct sockaddr_un unixAddress;
+    const struct sockaddr* address;
+    socklen_t addressLen;
+    if (strncmp(target, "unix:", 5) == 0) {
+        memset(&unixAddress, 0, sizeof(unixAddress));
+        unixAddress.sun_family = AF_UNIX;
+        strncpy(unixAddress.sun_path, target + 5, sizeof(unixAddress.sun_path) - 1);
+        address = (struct sockaddr*) &unixAddress;
+        addressLen = sizeof(unixAddress);
+    } else {
+        memset(&inetAddress, 0, sizeof(inetAddress));
+        inetAddress.sin_family = AF_INET;
+        inetAddress.sin_port = htons(atoi(target));
+        inet_pton(AF_INET, "127.0.0.1", &inetAddress.sin_addr);
+        address = (struct sockaddr*) &inetAddress;
+        addressLen = sizeof(inetAddress);
+    }
+    long* latencies = malloc(sizeof(long) * (count > LARGE_REQUESTS ? count : LARGE_REQUESTS));
+    char request[64], digits[32];
+    const int requestLen = snprintf(request, sizeof(request), "GET /fib?num=%d HTTP/1.1\r\nConnection: close\r\n\r\n", num);
+
+    long start = nowNanos();
+    for (int i = 0; i < count; i++) {
+        const long from = nowNanos();
+        if (reconnectCall(address, addressLen, request, requestLen) < 0)
+            failed++;
+        latencies[i] = nowNanos() - from;
+    }
+    report("reconnect", count, nowNanos() - start, latencies);
+
+    fibClient* c = fibClientNew(connections, depth);
+    if (c == NULL || fibClientGet(c, target, num, TIMEOUT_MS, digits, sizeof(digits)) < 0) {
+        fprintf(stderr, "Cannot reach \"%s\".\n", target);
+        return EXIT_FAILURE;
+    }
+    start = nowNanos();
+    for (int i = 0; i < count; i++) {
+        const long from = nowNanos();
+        const int len = fibClientGet(c, target, num, TIMEOUT_MS, digits, sizeof(digits));
+        if (len < 0 || len >= (int) sizeof(digits))
+            failed++;
+        latencies[i] = nowNanos() - from;
+    }
+    report("pooled", count, nowNanos() - start, latencies);
+
+    start = nowNanos();
+    for (int i = 0; i < count; i++)
+        if (fibClientSubmit(c, target, num, TIMEOUT_MS, onAnswer, NULL) < 0)
+            failed++;
+    fibClientRun(c, -1);
+    report("pipelined", count, nowNanos() - start, NULL);
+    printf("(%d connections, %d deep, %d answered)\n", connections, depth, answered);
+
+    char* largeDigits = malloc(LARGE_DIGITS_CAP);
+    int largeLen = 0;
+    start = nowNanos();
+    for (int i = 0; i < LARGE_REQUESTS; i++) {
+        const long from = nowNanos();
+        const int len = fibClientGet(c, target, large, TIMEOUT_MS, largeDigits, LARGE_DIGITS_CAP);
+        if (len <= 0 || len >= LARGE_DIGITS_CAP || (largeLen != 0 && len != largeLen))
+            failed++;
+        else
+            largeLen = len;
+        latencies[i] = nowNanos() - from;
+    }
+    report("large", LARGE_REQUESTS, nowNanos() - start, latencies);
+    printf("(F(%d), %d digits)\n", large, largeLen);
+    free(largeDigits);
+    fibClientFree(c);
+    free(latencies);
+    return EXIT_SUCCESS;
+}
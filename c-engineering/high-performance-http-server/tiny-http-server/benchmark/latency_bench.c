@@ -0,0 +1,97 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// sends requests to a running server one at a time, each on a new connection,
+// and reports the round-trip latency percentiles in microseconds. the target is
+// a TCP port on 127.0.0.1 or "unix:/path".
+//
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libs/structs.h"
+
+#define WARMUP_REQUESTS 1000
+
+static long nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int compareLong(const void* a, const void* b) {
+    const long x = *(const long*) a, y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+// one request and its whole response, the server closes the connection after answering.
+static long roundTrip(const sockaddr* address, socklen_t addressLen, const char* request, size_t len) {
+    const long start = nowNanos();
+    const int fd = socket(address->sa_family, SOCK_STREAM, 0);
+    const int on = 1;
+    if (address->sa_family == AF_INET)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (connect(fd, address, addressLen) < 0 || write(fd, request, len) != (ssize_t) len) {
+        close(fd);
+        return -1;
+    }
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0);
+    close(fd);
+    return n < 0 ? -1 : nowNanos() - start;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* target = argc > 1 ? argv[1] : "8080";
+    const int count = argc > 2 ? atoi(argv[2]) : 20000;
+    const char* num = argc > 3 ? argv[3] : "20";
+
+    sockaddr_in inetAddress;
+    sockaddr_un unixAddress;
+    const sockaddr* address;
+    socklen_t addressLen;
+    if (strncmp(target, "unix:", 5) == 0) {
+        memset(&unixAddress, 0, sizeof(unixAddress));
+        unixAddress.sun_family = AF_UNIX;
+        strncpy(unixAddress.sun_path, target + 5, sizeof(unixAddress.sun_path) - 1);
+        address = (const sockaddr*) &unixAddress;
+        addressLen = sizeof(unixAddress);
+    } else {
+        memset(&inetAddress, 0, sizeof(inetAddress));
+        inetAddress.sin_family = AF_INET;
+        inetAddress.sin_port = htons(atoi(target));
+        inet_pton(AF_INET, "127.0.0.1", &inetAddress.sin_addr);
+        address = (const sockaddr*) &inetAddress;
+        addressLen = sizeof(inetAddress);
+    }
+    char request[256];
+    const int len = snprintf(request, sizeof(request), "GET /?num=%s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n", num);
+
+    for (int i = 0; i < WARMUP_REQUESTS; i++)
+        roundTrip(address, addressLen, request, len);
+    long* samples = malloc(sizeof(long) * count);
+    int ok = 0;
+    for (int i = 0; i < count; i++) {
+        const long nanos = roundTrip(address, addressLen, request, len);
+        if (nanos >= 0)
+            samples[ok++] = nanos;
+    }
+    if (ok == 0) {
+        fprintf(stderr, "No request succeeded, is the server listening on %s?\n", target);
+        return EXIT_FAILURE;
+    }
+    qsort(samples, ok, sizeof(long), compareLong);
+    printf("target: %s\n", target);
+    printf("requests: %d ok, %d failed\n", ok, count - ok);
+    printf("latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           samples[ok / 2] / 1e3, samples[ok * 9 / 10] / 1e3, samples[ok * 99 / 100] / 1e3,
+           samples[ok * 999 / 1000] / 1e3, samples[ok - 1] / 1e3);
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// replays the request heads of a corpus against a running server from several
+// closed-loop clients, each sending the next request once the previous response
+// is complete, and reports requests per second and latency percentiles.
+//
+// usage: load-bench <port | unix:/path> <corpus> [connections] [seconds]
+//
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libs/structs.h"
+
+#define MAX_SAMPLES_PER_CLIENT (1 << 20)
+
+typedef struct {
+    char* data;
+    size_t len;
+} request;
+
+static request* requests;
+static int requestCount;
+static sockaddr_in inetAddress;
+static sockaddr_un unixAddress;
+static const sockaddr* address;
+static socklen_t addressLen;
+static double seconds;
+
+typedef struct {
+    int id;
+    long* samples;
+    long count;
+    long failed;
+} client;
+
+static long nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int compareLong(const void* a, const void* b) {
+    const long x = *(const long*) a, y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+static int loadCorpus(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    rewind(fp);
+    char* raw = malloc(size + 1);
+    if (fread(raw, 1, size, fp) != (size_t) size) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    raw[size] = '\0';
+    for (char* p = raw; p < raw + size;) {
+        char* term = strstr(p, "\r\n\r\n");
+        const size_t len = term == NULL ? (size_t) (raw + size - p) : (size_t) (term + 4 - p);
+        requests = realloc(requests, sizeof(request) * (requestCount + 1));
+        requests[requestCount++] = (request) { p, len };
+        p += len;
+    }
+    return requestCount;
+}
+
+// one request per connection, timed from connect to the end of the response.
+// reads one response: its head, then as many bytes as its Content-Length says. one without
+// (only an error the server closes after) ends at EOF. -1 on a read error or a cut response.
+static int readResponse(int fd) {
+    char buf[16384];
+    size_t have = 0;
+    ssize_t n = 0;
+    const char* headEnd;
+    while ((headEnd = memmem(buf, have, "\r\n\r\n", 4)) == NULL) {
+        if (have == sizeof(buf) || (n = read(fd, buf + have, sizeof(buf) - have)) <= 0)
+            return n == 0 && have > 0 ? 0 : -1;
+        have += n;
+    }
+    const size_t headLen = headEnd + 4 - buf;
+    size_t bodyLen = SIZE_MAX;
+    for (const char* line = memchr(buf, '\n', headLen); line != NULL && line < headEnd;
+         line = memchr(line + 1, '\n', headEnd - line - 1))
+        if (strncasecmp(line + 1, "Content-Length:", 15) == 0)
+            bodyLen = strtoull(line + 16, NULL, 10);
+    for (size_t got = have - headLen; got < bodyLen; got += n)
+        if ((n = read(fd, buf, sizeof(buf))) <= 0)
+            return n == 0 && bodyLen == SIZE_MAX ? 0 : -1;
+    return 0;
+}
+
+static long roundTrip(const request* req) {
+    const long start = nowNanos();
+    const int fd = socket(address->sa_family, SOCK_STREAM, 0);
+    const int on = 1;
+    if (address->sa_family == AF_INET)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (connect(fd, address, addressLen) < 0 || write(fd, req->data, req->len) != (ssize_t) req->len) {
+        close(fd);
+        return -1;
+    }
+    // the connection may stay open (HTTP/1.1 keep-alive), so the response ends where its length says.
+    const int result = readResponse(fd);
+    close(fd);
+    return result < 0 ? -1 : nowNanos() - start;
+}
+
+static void* runClient(void* arg) {
+    client* c = arg;
+    const long deadline = nowNanos() + (long) (seconds * 1e9);
+    for (long i = c->id; nowNanos() < deadline && c->count < MAX_SAMPLES_PER_CLIENT; i++) {
+        const long nanos = roundTrip(&requests[i % requestCount]);
+        if (nanos < 0)
+            c->failed++;
+        else
+            c->samples[c->count++] = nanos;
+    }
+    return NULL;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: load-bench <port | unix:/path> <corpus> [connections] [seconds]\n");
+        return EXIT_FAILURE;
+    }
+    const char* target = argv[1];
+    const int connections = argc > 3 ? atoi(argv[3]) : 8;
+    seconds = argc > 4 ? atof(argv[4]) : 5.0;
+    if (loadCorpus(argv[2]) <= 0) {
+        fprintf(stderr, "Cannot load corpus \"%s\".\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (strncmp(target, "unix:", 5) == 0) {
+        unixAddress.sun_family = AF_UNIX;
+        strncpy(unixAddress.sun_path, target + 5, sizeof(unixAddress.sun_path) - 1);
+        address = (const sockaddr*) &unixAddress;
+        addressLen = sizeof(unixAddress);
+    } else {
+        inetAddress.sin_family = AF_INET;
+        inetAddress.sin_port = htons(atoi(target));
+        inet_pton(AF_INET, "127.0.0.1", &inetAddress.sin_addr);
+        address = (const sockaddr*) &inetAddress;
+        addressLen = sizeof(inetAddress);
+    }
+
+    client clients[connections];
+    pthread_t threads[connections];
+    for (int i = 0; i < connections; i++) {
+        clients[i] = (client) { i, malloc(sizeof(long) * MAX_SAMPLES_PER_CLIENT), 0, 0 };
+        pthread_create(&threads[i], NULL, runClient, &clients[i]);
+    }
+    long total = 0, failed = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        total += clients[i].count;
+        failed += clients[i].failed;
+    }
+    if (total == 0) {
+        fprintf(stderr, "No request succeeded, is the server listening on %s?\n", target);
+        return EXIT_FAILURE;
+    }
+    long* all = malloc(sizeof(long) * total);
+    for (int i = 0, off = 0; i < connections; off += clients[i].count, i++)
+        memcpy(all + off, clients[i].samples, sizeof(long) * clients[i].count);
+    qsort(all, total, sizeof(long), compareLong);
+    printf("target: %s, %d connections, %.1f s, corpus of %d requests\n", target, connections, seconds, requestCount);
+    printf("requests: %ld ok, %ld failed, %.0f req/s\n", total, failed, total / seconds);
+    printf("latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           all[total / 2] / 1e3, all[total * 9 / 10] / 1e3, all[total * 99 / 100] / 1e3,
+           all[total * 999 / 1000] / 1e3, all[total - 1] / 1e3);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// re-issues a trace written by the server's capture mode ("capture=<path>") against a
+// running server. "original" keeps the recorded arrival times (open loop, so a slow
+// server falls behind and the lag is reported), "max" sends as fast as the connections
+// allow. reports requests per second and latency percentiles.
+//
+// usage: replay <port | unix:/path> <capture file> [original | max] [connections]
+//
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libs/capture.h"
+
+typedef struct {
+    uint64_t offsetNs;
+    uint32_t len;
+    char* data;
+} traceRequest;
+
+typedef struct {
+    int id;
+    long* samples;
+    long count;
+    long failed;
+    long maxLagNs;
+} client;
+
+static traceRequest* trace;
+static long traceCount;
+static int connections;
+static int originalTiming;
+static long startNs;
+static sockaddr_in inetAddress;
+static sockaddr_un unixAddress;
+static const sockaddr* address;
+static socklen_t addressLen;
+
+static long nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int compareLong(const void* a, const void* b) {
+    const long x = *(const long*) a, y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+static int compareArrival(const void* a, const void* b) {
+    const uint64_t x = ((const traceRequest*) a)->offsetNs, y = ((const traceRequest*) b)->offsetNs;
+    return (x > y) - (x < y);
+}
+
+static long loadTrace(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    captureHeader header;
+    if (fp == NULL || fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, CAPTURE_MAGIC, 8) != 0) {
+        if (fp != NULL)
+            fclose(fp);
+        return -1;
+    }
+    captureRecord rec;
+    long cap = 0;
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        char* data = malloc(rec.len);
+        if (fread(data, 1, rec.len, fp) != rec.len) {
+            free(data);  // a torn tail from a server that was killed mid-write.
+            break;
+        }
+        if (traceCount == cap)
+            trace = realloc(trace, sizeof(traceRequest) * (cap = cap ? cap * 2 : 1024));
+        trace[traceCount++] = (traceRequest) { rec.offsetNs, rec.len, data };
+    }
+    fclose(fp);
+    // concurrent workers append in write order, which may differ slightly from arrival order.
+    qsort(trace, traceCount, sizeof(traceRequest), compareArrival);
+    return traceCount;
+}
+
+// reads one response: its head, then as many bytes as its Content-Length says. one without
+// (only an error the server closes after) ends at EOF. -1 on a read error or a cut response.
+static int readResponse(int fd) {
+    char buf[16384];
+    size_t have = 0;
+    ssize_t n = 0;
+    const char* headEnd;
+    while ((headEnd = memmem(buf, have, "\r\n\r\n", 4)) == NULL) {
+        if (have == sizeof(buf) || (n = read(fd, buf + have, sizeof(buf) - have)) <= 0)
+            return n == 0 && have > 0 ? 0 : -1;
+        have += n;
+    }
+    const size_t headLen = headEnd + 4 - buf;
+    size_t bodyLen = SIZE_MAX;
+    for (const char* line = memchr(buf, '\n', headLen); line != NULL && line < headEnd;
+         line = memchr(line + 1, '\n', headEnd - line - 1))
+        if (strncasecmp(line + 1, "Content-Length:", 15) == 0)
+            bodyLen = strtoull(line + 16, NULL, 10);
+    for (size_t got = have - headLen; got < bodyLen; got += n)
+        if ((n = read(fd, buf, sizeof(buf))) <= 0)
+            return n == 0 && bodyLen == SIZE_MAX ? 0 : -1;
+    return 0;
+}
+
+static long roundTrip(const traceRequest* req) {
+    const long start = nowNanos();
+    const int fd = socket(address->sa_family, SOCK_STREAM, 0);
+    const int on = 1;
+    if (address->sa_family == AF_INET)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (connect(fd, address, addressLen) < 0 || write(fd, req->data, req->len) != (ssize_t) req->len) {
+        close(fd);
+        return -1;
+    }
+    // the connection may stay open (HTTP/1.1 keep-alive), so the response ends where its length says.
+    const int result = readResponse(fd);
+    close(fd);
+    return result < 0 ? -1 : nowNanos() - start;
+}
+
+// client i sends requests i, i + connections, ...
+static void* runClient(void* arg) {
+    client* c = arg;
+    const uint64_t firstOffset = trace[0].offsetNs;
+    for (long i = c->id; i < traceCount; i += connections) {
+        if (originalTiming) {
+            const long due = startNs + (long) (trace[i].offsetNs - firstOffset);
+            const long lag = nowNanos() - due;
+            if (lag < 0) {
+                const struct timespec until = { due / 1000000000L, due % 1000000000L };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+            } else if (lag > c->maxLagNs) {
+                c->maxLagNs = lag;
+            }
+        }
+        const long nanos = roundTrip(&trace[i]);
+        if (nanos < 0)
+            c->failed++;
+        else
+            c->samples[c->count++] = nanos;
+    }
+    return NULL;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: replay <port | unix:/path> <capture file> [original | max] [connections]\n");
+        return EXIT_FAILURE;
+    }
+    const char* target = argv[1];
+    originalTiming = argc <= 3 || strcmp(argv[3], "max") != 0;
+    connections = argc > 4 ? atoi(argv[4]) : 64;
+    if (loadTrace(argv[2]) <= 0) {
+        fprintf(stderr, "Cannot load a capture from \"%s\".\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (strncmp(target, "unix:", 5) == 0) {
+        unixAddress.sun_family = AF_UNIX;
+        strncpy(unixAddress.sun_path, target + 5, sizeof(unixAddress.sun_path) - 1);
+        address = (const sockaddr*) &unixAddress;
+        addressLen = sizeof(unixAddress);
+    } else {
+        inetAddress.sin_family = AF_INET;
+        inetAddress.sin_port = htons(atoi(target));
+        inet_pton(AF_INET, "127.0.0.1", &inetAddress.sin_addr);
+        address = (const sockaddr*) &inetAddress;
+        addressLen = sizeof(inetAddress);
+    }
+
+    client clients[connections];
+    pthread_t threads[connections];
+    startNs = nowNanos();
+    for (int i = 0; i < connections; i++) {
+        clients[i] = (client) { i, malloc(sizeof(long) * (traceCount / connections + 1)), 0, 0, 0 };
+        pthread_create(&threads[i], NULL, runClient, &clients[i]);
+    }
+    long total = 0, failed = 0, maxLagNs = 0;
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        total += clients[i].count;
+        failed += clients[i].failed;
+        maxLagNs = clients[i].maxLagNs > maxLagNs ? clients[i].maxLagNs : maxLagNs;
+    }
+    const double elapsed = (nowNanos() - startNs) / 1e9;
+    if (total == 0) {
+        fprintf(stderr, "No request succeeded, is the server listening on %s?\n", target);
+        return EXIT_FAILURE;
+    }
+    long* all = malloc(sizeof(long) * total);
+    for (int i = 0, off = 0; i < connections; off += clients[i].count, i++)
+        memcpy(all + off, clients[i].samples, sizeof(long) * clients[i].count);
+    qsort(all, total, sizeof(long), compareLong);
+    printf("trace: %s, %ld requests over %.3f s recorded, %s timing, %d connections\n", argv[2], traceCount,
+           (trace[traceCount - 1].offsetNs - trace[0].offsetNs) / 1e9, originalTiming ? "original" : "max", connections);
+    printf("requests: %ld ok, %ld failed in %.3f s, %.0f req/s\n", total, failed, elapsed, total / elapsed);
+    printf("latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           all[total / 2] / 1e3, all[total * 9 / 10] / 1e3, all[total * 99 / 100] / 1e3,
+           all[total * 999 / 1000] / 1e3, all[total - 1] / 1e3);
+    if (originalTiming)
+        printf("schedule: max lag %.1f us behind the recorded arrival\n", maxLagNs / 1e3);
+    return EXIT_SUCCESS;
+}
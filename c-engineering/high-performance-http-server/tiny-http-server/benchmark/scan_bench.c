@@ -0,0 +1,109 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// parses a recorded corpus of request heads with every delimiter-scanning kernel
+// the CPU supports and reports the throughput in GB/s.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libs/chain.h"
+#include "libs/http.h"
+#include "libs/scan.h"
+
+#define BENCH_SECONDS 1.0
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// wraps every head of the corpus into a single-segment chain, like the server would hold it.
+static int loadCorpus(const char* path, bufSeg*** segsOut, size_t* bytesOut) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    rewind(fp);
+    char* raw = malloc(size);
+    if (fread(raw, 1, size, fp) != (size_t) size) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    int count = 0;
+    bufSeg** segs = NULL;
+    for (const char* p = raw; p < raw + size;) {
+        const char* term = strstr(p, "\r\n\r\n");
+        const size_t len = term == NULL ? (size_t) (raw + size - p) : (size_t) (term + 4 - p);
+        bufSeg* seg = malloc(sizeof(bufSeg) + len + 1);
+        seg->next = NULL;
+        seg->poolCap = seg->cap = seg->len = len;
+        seg->start = 0;
+        memcpy(seg->data, p, len);
+        seg->data[len] = '\0';
+        segs = realloc(segs, sizeof(bufSeg*) * (count + 1));
+        segs[count++] = seg;
+        *bytesOut += len;
+        p += len;
+    }
+    free(raw);
+    *segsOut = segs;
+    return count;
+}
+
+static size_t parseHead(bufSeg* seg) {
+    bufChain bc = { seg, seg, seg->len };
+    httpHeadParser hp;
+    headParserInit(&hp, &bc);
+    if (!headParse(&hp, &bc))
+        return 0;
+    size_t lineLen;
+    const char* line = headRequestLine(&hp, &bc, &lineLen);
+    httpRequestLine rl;
+    if (httpParseRequestLine(line, lineLen, &rl) < 0)
+        return 0;
+    size_t sum = rl.path.len + rl.query.len;
+    httpHeadCursor hc;
+    headCursorInit(&hc, &hp, &bc);
+    strSpan name, value;
+    while (headNextField(&hc, &name, &value))
+        sum += name.len + value.len;
+    headCursorRelease(&hc);
+    return sum;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* path = argc > 1 ? argv[1] : "benchmark/corpus/requests.http";
+    bufSeg** segs;
+    size_t corpusBytes = 0;
+    const int count = loadCorpus(path, &segs, &corpusBytes);
+    if (count <= 0) {
+        fprintf(stderr, "Cannot load corpus \"%s\".\n", path);
+        return EXIT_FAILURE;
+    }
+    printf("corpus: %s, %d requests, %zu bytes\n", path, count, corpusBytes);
+
+    const char* impls[] = { "scalar", "sse4.2", "avx2" };
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (scanSelect(impls[i]) < 0) {
+            printf("%-8s unsupported\n", impls[i]);
+            continue;
+        }
+        size_t rounds = 0, checksum = 0;
+        const double start = now();
+        double elapsed;
+        do {
+            for (int r = 0; r < 64; r++, rounds++)
+                for (int j = 0; j < count; j++)
+                    checksum += parseHead(segs[j]);
+        } while ((elapsed = now() - start) < BENCH_SECONDS);
+        printf("%-8s %8.3f GB/s  %10.0f req/s  (checksum %zu)\n", scanImplName(),
+               rounds * corpusBytes / elapsed / 1e9, rounds * count / elapsed, checksum / rounds);
+    }
+    return EXIT_SUCCESS;
+}
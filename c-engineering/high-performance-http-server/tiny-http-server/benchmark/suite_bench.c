@@ -0,0 +1,263 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// the in-process half of the "bench" target: times the request parser with every scanning
+// kernel, the router, each compute kernel and the response formatting. every metric is run
+// for several rounds and written as one tab-separated line, the median of the rounds and their
+// spread (median absolute deviation over median), which "tools/bench-compare.awk" uses to
+// tell a regression from noise.
+//
+// usage: suite-bench <corpus> [plugin.so] [rounds]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libs/batch.h"
+#include "libs/bigint.h"
+#include "libs/chain.h"
+#include "libs/degrade.h"
+#include "libs/fibmod.h"
+#include "libs/helpers.h"
+#include "libs/http.h"
+#include "libs/macros.h"
+#include "libs/plugin.h"
+#include "libs/router.h"
+#include "libs/scan.h"
+
+#define ROUND_SECONDS 0.2
+#define MAX_ROUNDS 32
+
+typedef size_t (*benchFn)(void* arg);  // runs one batch, returns how many operations it did.
+
+static volatile size_t sink;  // keeps results alive so nothing is optimised away.
+static bufSeg** segs;
+static int segCount;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDouble(const void* a, const void* b) {
+    const double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// writes "metric  median  spread  ns/op  lower" for "rounds" rounds of "fn".
+static void measure(const char* metric, int rounds, benchFn fn, void* arg) {
+    double samples[MAX_ROUNDS], deviations[MAX_ROUNDS];
+    fn(arg);  // warm caches and branch predictors.
+    for (int r = 0; r < rounds; r++) {
+        size_t ops = 0;
+        const double start = now();
+        double elapsed;
+        do
+            ops += fn(arg);
+        while ((elapsed = now() - start) < ROUND_SECONDS);
+        samples[r] = elapsed * 1e9 / ops;
+    }
+    qsort(samples, rounds, sizeof(double), compareDouble);
+    const double median = samples[rounds / 2];
+    for (int r = 0; r < rounds; r++)
+        deviations[r] = samples[r] > median ? samples[r] - median : median - samples[r];
+    qsort(deviations, rounds, sizeof(double), compareDouble);
+    printf("%s\t%.3f\t%.4f\tns/op\tlower\n", metric, median, deviations[rounds / 2] / median);
+    fflush(stdout);
+}
+
+static int loadCorpus(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    rewind(fp);
+    char* raw = malloc(size);
+    if (fread(raw, 1, size, fp) != (size_t) size) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    for (const char* p = raw; p < raw + size;) {
+        const char* term = strstr(p, "\r\n\r\n");
+        const size_t len = term == NULL ? (size_t) (raw + size - p) : (size_t) (term + 4 - p);
+        bufSeg* seg = malloc(sizeof(bufSeg) + len + 1);
+        seg->next = NULL;
+        seg->poolCap = seg->cap = seg->len = len;
+        seg->start = 0;
+        memcpy(seg->data, p, len);
+        seg->data[len] = '\0';
+        segs = realloc(segs, sizeof(bufSeg*) * (segCount + 1));
+        segs[segCount++] = seg;
+        p += len;
+    }
+    free(raw);
+    return segCount;
+}
+
+// the head parse "handleRequest" does: request line, then every header.
+static size_t benchParse(void* arg) {
+    (void) arg;
+    size_t sum = 0;
+    for (int i = 0; i < segCount; i++) {
+        bufSeg* seg = segs[i];
+        bufChain bc = { seg, seg, seg->len };
+        httpHeadParser hp;
+        headParserInit(&hp, &bc);
+        if (!headParse(&hp, &bc))
+            continue;
+        size_t lineLen;
+        const char* line = headRequestLine(&hp, &bc, &lineLen);
+        httpRequestLine rl;
+        if (httpParseRequestLine(line, lineLen, &rl) < 0)
+            continue;
+        sum += rl.path.len;
+        httpHeadCursor hc;
+        headCursorInit(&hc, &hp, &bc);
+        strSpan name, value;
+        while (headNextField(&hc, &name, &value))
+            sum += value.len;
+        headCursorRelease(&hc);
+    }
+    sink += sum;
+    return segCount;
+}
+
+static size_t benchRoute(void* arg) {
+    (void) arg;
+    static const char* paths[] = { "/", "/fib", "/health", "/stats", "/static/app.js", "/missing", "/fib/x" };
+    const size_t count = sizeof(paths) / sizeof(paths[0]);
+    for (int r = 0; r < 1024; r++)
+        for (size_t i = 0; i < count; i++)
+            sink += routeLookup(paths[i], strlen(paths[i]));
+    return 1024 * count;
+}
+
+static size_t benchRecursion(void* arg) {
+    sink += __calcFibRecursion(*(int*) arg);
+    return 1;
+}
+
+static size_t benchTCO(void* arg) {
+    for (int r = 0; r < 1024; r++)
+        sink += __calcFibTCO(*(int*) arg, 0, 1);
+    return 1024;
+}
+
+static size_t benchPlugin(void* arg) {
+    char buf[32];
+    const computePlugin* plugin = pluginAcquire();
+    for (int r = 0; r < 1024; r++)
+        sink += plugin->fibDigits(*(int*) arg, buf, sizeof(buf));
+    pluginRelease(plugin);
+    return 1024;
+}
+
+// a full micro-batch of mixed "num" up to 93, per request.
+static size_t benchBatch(void* arg) {
+    const int* nums = arg;
+    uint64_t values[BATCH_MAX];
+    for (int r = 0; r < 1024; r++) {
+        batchFib(nums, values, BATCH_MAX);
+        sink += values[r % BATCH_MAX];
+    }
+    return 1024 * BATCH_MAX;
+}
+
+// "/fibmod" for the largest n, "arg" holds n and m.
+static size_t benchFibMod(void* arg) {
+    const uint64_t* nm = arg;
+    uint64_t residue;
+    for (int r = 0; r < 1024; r++) {
+        fibMod(nm[0] - r, nm[1], &residue);
+        sink += residue;
+    }
+    return 1024;
+}
+
+// the exact digits of F(n) past what 64 bits hold, on the caller alone.
+static size_t benchBigFib(void* arg) {
+    size_t len;
+    char* digits = bigFibDigits(*(long*) arg, &len);
+    sink += len;
+    free(digits);
+    return 1;
+}
+
+// the Binet estimate an overloaded worker answers with instead.
+static size_t benchBinet(void* arg) {
+    char digits[32];
+    double error;
+    for (int r = 0; r < 1024; r++)
+        sink += degradeFibApprox(*(long*) arg - r, digits, sizeof(digits), &error);
+    return 1024;
+}
+
+// what "respondFib" does after the kernel: digits and the response around them.
+static size_t benchFormat(void* arg) {
+    char digits[32], res[128];
+    for (int r = 0; r < 1024; r++) {
+        const int len = snprintf(digits, sizeof(digits), "%d", *(int*) arg + r);
+        sink += snprintf(res, sizeof(res), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%.*s", len, len, digits);
+    }
+    return 1024;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: suite-bench <corpus> [plugin.so] [rounds]\n");
+        return EXIT_FAILURE;
+    }
+    if (loadCorpus(argv[1]) <= 0) {
+        fprintf(stderr, "Cannot load corpus \"%s\".\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    const int rounds = argc > 3 && atoi(argv[3]) > 0 ? (atoi(argv[3]) < MAX_ROUNDS ? atoi(argv[3]) : MAX_ROUNDS) : 7;
+
+    const char* impls[] = { "scalar", "sse4.2", "avx2" };
+    char metric[64];
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (scanSelect(impls[i]) < 0)
+            continue;  // not on this CPU, the comparison reports it as missing.
+        snprintf(metric, sizeof(metric), "parse.%s", scanImplName());
+        measure(metric, rounds, benchParse, NULL);
+    }
+    scanInit();  // the rest runs with what the server would pick.
+    measure("route.lookup", rounds, benchRoute, NULL);
+
+    int n = 25;
+    measure("compute.recursion.n25", rounds, benchRecursion, &n);
+    n = 46;  // the largest F(n) an int holds.
+    measure("compute.tco.n46", rounds, benchTCO, &n);
+    if (argc > 2 && pluginLoad(argv[2]) == 0 && pluginActive()->fibDigits != NULL) {
+        n = 93;
+        snprintf(metric, sizeof(metric), "compute.%s.n93", pluginActive()->name);
+        measure(metric, rounds, benchPlugin, &n);
+    }
+    int nums[BATCH_MAX];
+    for (int i = 0; i < BATCH_MAX; i++)
+        nums[i] = BATCH_FIB_LIMIT - 1 - i * 7 % 64;
+    const char* lanes[] = { "scalar", "avx2", "avx512" };
+    for (size_t i = 0; i < sizeof(lanes) / sizeof(lanes[0]); i++) {
+        if (batchSelect(lanes[i]) < 0)
+            continue;
+        snprintf(metric, sizeof(metric), "compute.batch.%s.x%d", batchImplName(), BATCH_MAX);
+        measure(metric, rounds, benchBatch, nums);
+    }
+    // an odd modulus is all Montgomery, an even one adds the power of two, a small one is cut
+    // down by its cached Pisano period first.
+    uint64_t odd[] = { UINT64_MAX, UINT64_MAX - 58 }, even[] = { UINT64_MAX, (UINT64_MAX - 58) << 1 },
+             pisano[] = { UINT64_MAX, 65521 };
+    measure("compute.fibmod.odd", rounds, benchFibMod, odd);
+    measure("compute.fibmod.even", rounds, benchFibMod, even);
+    measure("compute.fibmod.pisano", rounds, benchFibMod, pisano);
+    long bigN = 100000;
+    measure("compute.bigfib.n100000", rounds, benchBigFib, &bigN);
+    bigN = 1000000;
+    measure("compute.binet.n1000000", rounds, benchBinet, &bigN);
+    n = 832040;
+    measure("format.response", rounds, benchFormat, &n);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,564 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "fibclient.h"
+
+#define MAX_CONNS 64
+#define MAX_DEPTH 64
+#define MAX_HOST 128
+#define REQUEST_MAX (MAX_HOST + 80)
+#define IN_CAP 4096  // what a connection starts with, it grows for a bigger response.
+#define IN_MAX (4 << 20)  // the largest response taken, F(10^7) (the server's default limit) has 2089877 digits.
+#define RETRIES 3  // tries per call when connections break under it, "/fib" is safe to repeat.
+
+enum { CONN_CLOSED, CONN_CONNECTING, CONN_READY };
+
+typedef struct fibCall {
+    struct fibCall* next;  // in a pool's queue, or the spare list.
+    int num;
+    int attempts;
+    long deadline;  // monotonic ns, LONG_MAX without one.
+    fibCallback fn;
+    void* arg;
+} fibCall;
+
+typedef struct fibPool fibPool;
+
+typedef struct {
+    fibPool* pool;
+    int fd;
+    int state;
+    int closing;  // the server closes after the last answer, nothing more is sent on it.
+    fibCall* sent[MAX_DEPTH];  // in flight, answered in this order.
+    int first;
+    int count;
+    char out[MAX_DEPTH * REQUEST_MAX];
+    size_t outOff;
+    size_t outLen;
+    char* in;
+    size_t inCap;
+    size_t inLen;
+} fibConn;
+
+// the connections to one endpoint and the calls waiting for room on them.
+struct fibPool {
+    fibPool* next;
+    char endpoint[MAX_HOST + 8];
+    char host[MAX_HOST];  // for the Host header.
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    fibCall* head;
+    fibCall* tail;
+    fibConn conns[];
+};
+
+struct fibClient {
+    int maxConns;
+    int depth;
+    fibPool* pools;
+    int poolCount;
+    fibCall* spare;
+    int active;  // submitted and not completed yet.
+    long nextExpiry;  // no deadline passes before this.
+    struct pollfd* pfds;
+    fibConn** polled;
+    int pollCap;
+};
+
+static long now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// "maxConns" keep-alive connections per host, each with up to "depth" requests in flight.
+fibClient* fibClientNew(int maxConns, int depth) {
+    fibClient* c = calloc(1, sizeof(fibClient));
+    if (c == NULL)
+        return NULL;
+    c->maxConns = maxConns < 1 ? 1 : maxConns > MAX_CONNS ? MAX_CONNS : maxConns;
+    c->depth = depth < 1 ? 1 : depth > MAX_DEPTH ? MAX_DEPTH : depth;
+    c->nextExpiry = LONG_MAX;
+    return c;
+}
+
+// "port" (on 127.0.0.1), "host:port" or "unix:/path".
+static int resolve(fibPool* pool, const char* endpoint) {
+    if (strncmp(endpoint, "unix:", 5) == 0) {
+        struct sockaddr_un* un = (struct sockaddr_un*) &pool->addr;
+        if (strlen(endpoint + 5) >= sizeof(un->sun_path))
+            return -1;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, endpoint + 5);
+        pool->addrLen = sizeof(struct sockaddr_un);
+        strcpy(pool->host, "localhost");
+        return 0;
+    }
+    char host[MAX_HOST];
+    const char* colon = strrchr(endpoint, ':');
+    const char* port = colon != NULL ? colon + 1 : endpoint;
+    if (colon == NULL)
+        strcpy(host, "127.0.0.1");
+    else if ((size_t) (colon - endpoint) < sizeof(host))
+        snprintf(host, sizeof(host), "%.*s", (int) (colon - endpoint), endpoint);
+    else
+        return -1;
+    // resolved once per pool, connections opened later reuse the address.
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_NUMERICSERV };
+    struct addrinfo* found;
+    if (getaddrinfo(host, port, &hints, &found) != 0)
+        return -1;
+    memcpy(&pool->addr, found->ai_addr, found->ai_addrlen);
+    pool->addrLen = found->ai_addrlen;
+    freeaddrinfo(found);
+    snprintf(pool->host, sizeof(pool->host), "%s:%s", host, port);
+    return 0;
+}
+
+static fibPool* poolFor(fibClient* c, const char* endpoint) {
+    for (fibPool* pool = c->pools; pool != NULL; pool = pool->next)
+        if (strcmp(pool->endpoint, endpoint) == 0)
+            return pool;
+    if (strlen(endpoint) >= sizeof(((fibPool*) NULL)->endpoint))
+        return NULL;
+    const int pollCap = (c->poolCount + 1) * c->maxConns;
+    struct pollfd* pfds = realloc(c->pfds, pollCap * sizeof(struct pollfd));
+    if (pfds != NULL)
+        c->pfds = pfds;
+    fibConn** polled = realloc(c->polled, pollCap * sizeof(fibConn*));
+    if (polled != NULL)
+        c->polled = polled;
+    fibPool* pool = calloc(1, sizeof(fibPool) + c->maxConns * sizeof(fibConn));
+    if (pfds == NULL || polled == NULL || pool == NULL || resolve(pool, endpoint) < 0) {
+        free(pool);
+        return NULL;
+    }
+    c->pollCap = pollCap;
+    strcpy(pool->endpoint, endpoint);
+    for (int i = 0; i < c->maxConns; i++) {
+        pool->conns[i].pool = pool;
+        pool->conns[i].fd = -1;
+    }
+    pool->next = c->pools;
+    c->pools = pool;
+    c->poolCount++;
+    return pool;
+}
+
+static void complete(fibClient* c, fibCall* call, int result, const char* digits, size_t len) {
+    c->active--;
+    call->fn(call->arg, result, digits, len);
+    call->next = c->spare;
+    c->spare = call;
+}
+
+// queues "num" for "endpoint", "fn" gets the result from within "fibClientRun". a "timeoutMs"
+// of 0 or less waits for as long as it takes.
+int fibClientSubmit(fibClient* c, const char* endpoint, int num, int timeoutMs, fibCallback fn, void* arg) {
+    fibPool* pool;
+    if (fn == NULL || num < 0 || (pool = poolFor(c, endpoint)) == NULL)
+        return FIB_INVALID;
+    fibCall* call = c->spare;
+    if (call != NULL)
+        c->spare = call->next;
+    else if ((call = malloc(sizeof(fibCall))) == NULL)
+        return FIB_ERROR;
+    call->next = NULL;
+    call->num = num;
+    call->attempts = 0;
+    call->deadline = timeoutMs > 0 ? now() + timeoutMs * 1000000L : LONG_MAX;
+    call->fn = fn;
+    call->arg = arg;
+    if (pool->tail != NULL)
+        pool->tail->next = call;
+    else
+        pool->head = call;
+    pool->tail = call;
+    c->active++;
+    if (call->deadline < c->nextExpiry)
+        c->nextExpiry = call->deadline;
+    return FIB_OK;
+}
+
+// makes room for "need" bytes in "in", at least doubling it, -1 past IN_MAX or without memory.
+static int connReserve(fibConn* conn, size_t need) {
+    if (need <= conn->inCap)
+        return 0;
+    if (need > IN_MAX)
+        return -1;
+    size_t cap = conn->inCap * 2 > need ? conn->inCap * 2 : need;
+    cap = cap < IN_MAX ? cap : IN_MAX;
+    char* in = realloc(conn->in, cap);
+    if (in == NULL)
+        return -1;
+    conn->in = in;
+    conn->inCap = cap;
+    return 0;
+}
+
+static void pushFront(fibPool* pool, fibCall* call) {
+    if ((call->next = pool->head) == NULL)
+        pool->tail = call;
+    pool->head = call;
+}
+
+// closes "conn", what it had in flight is tried again elsewhere unless "broken" used up its
+// last try or its deadline passed.
+static void connDrop(fibClient* c, fibConn* conn, int broken, long at) {
+    close(conn->fd);
+    conn->fd = -1;
+    conn->state = CONN_CLOSED;
+    conn->outOff = conn->outLen = conn->inLen = 0;
+    free(conn->in);
+    conn->in = NULL;
+    conn->inCap = 0;
+    // newest first, so they go back to the front of the queue in their order.
+    while (conn->count > 0) {
+        fibCall* call = conn->sent[(conn->first + --conn->count) % MAX_DEPTH];
+        if (call->deadline <= at)
+            complete(c, call, FIB_TIMEOUT, NULL, 0);
+        else if (broken && ++call->attempts >= RETRIES)
+            complete(c, call, FIB_ERROR, NULL, 0);
+        else
+            pushFront(conn->pool, call);
+    }
+}
+
+static int connOpen(fibConn* conn) {
+    const fibPool* pool = conn->pool;
+    if (connReserve(conn, IN_CAP) < 0)
+        return -1;
+    const int fd = socket(pool->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    const int on = 1;
+    if (pool->addr.ss_family != AF_UNIX)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (connect(fd, (const struct sockaddr*) &pool->addr, pool->addrLen) == 0) {
+        conn->state = CONN_READY;
+    } else if (errno == EINPROGRESS) {
+        conn->state = CONN_CONNECTING;  // requests queue up in "out" meanwhile.
+    } else {
+        close(fd);
+        return -1;
+    }
+    conn->fd = fd;
+    conn->closing = 0;
+    conn->first = conn->count = 0;
+    conn->outOff = conn->outLen = conn->inLen = 0;
+    return 0;
+}
+
+// hands queued calls to the least loaded connection, another one is opened while all are busy.
+static void dispatch(fibClient* c, fibPool* pool, long at) {
+    while (pool->head != NULL) {
+        fibConn *best = NULL, *closed = NULL;
+        int open = 0;
+        for (int i = 0; i < c->maxConns; i++) {
+            fibConn* conn = &pool->conns[i];
+            if (conn->state == CONN_CLOSED) {
+                if (closed == NULL)
+                    closed = conn;
+                continue;
+            }
+            open++;
+            if (!conn->closing && conn->count < c->depth && (best == NULL || conn->count < best->count))
+                best = conn;
+        }
+        if ((best == NULL || best->count > 0) && closed != NULL && connOpen(closed) == 0) {
+            best = closed;
+            open++;
+        }
+        if (best == NULL && open > 0)
+            return;  // every connection is full, the rest waits for answers.
+        fibCall* call = pool->head;
+        if ((pool->head = call->next) == NULL)
+            pool->tail = NULL;
+        if (call->deadline <= at) {
+            complete(c, call, FIB_TIMEOUT, NULL, 0);
+            continue;
+        }
+        if (best == NULL) {
+            complete(c, call, FIB_ERROR, NULL, 0);  // nothing open and the host refuses connections.
+            continue;
+        }
+        if (best->outOff == best->outLen)
+            best->outOff = best->outLen = 0;
+        else if (best->outLen + REQUEST_MAX > sizeof(best->out)) {
+            memmove(best->out, best->out + best->outOff, best->outLen - best->outOff);
+            best->outLen -= best->outOff;
+            best->outOff = 0;
+        }
+        best->outLen += snprintf(best->out + best->outLen, REQUEST_MAX,
+                                 "GET /fib?num=%d HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                                 call->num, pool->host);
+        best->sent[(best->first + best->count++) % MAX_DEPTH] = call;
+    }
+}
+
+// fails what waited past its deadline. an answer cannot be taken back from a pipelined
+// connection, so one holding an expired call is closed and the calls behind it retried.
+static void expire(fibClient* c, long at) {
+    if (at < c->nextExpiry)
+        return;
+    long next = LONG_MAX;
+    for (fibPool* pool = c->pools; pool != NULL; pool = pool->next) {
+        fibCall* prev = NULL;
+        for (fibCall* call = pool->head; call != NULL;) {
+            fibCall* following = call->next;
+            if (call->deadline <= at) {
+                if (prev != NULL)
+                    prev->next = following;
+                else
+                    pool->head = following;
+                if (pool->tail == call)
+                    pool->tail = prev;
+                complete(c, call, FIB_TIMEOUT, NULL, 0);
+            } else {
+                next = call->deadline < next ? call->deadline : next;
+                prev = call;
+            }
+            call = following;
+        }
+        for (int i = 0; i < c->maxConns; i++) {
+            fibConn* conn = &pool->conns[i];
+            for (int k = 0; k < conn->count; k++) {
+                if (conn->sent[(conn->first + k) % MAX_DEPTH]->deadline <= at) {
+                    connDrop(c, conn, 0, at);
+                    break;
+                }
+            }
+            for (int k = 0; k < conn->count; k++) {
+                const long deadline = conn->sent[(conn->first + k) % MAX_DEPTH]->deadline;
+                next = deadline < next ? deadline : next;
+            }
+        }
+    }
+    // the retried calls are back in the queues, their deadlines are still ahead.
+    for (fibPool* pool = c->pools; pool != NULL; pool = pool->next)
+        for (const fibCall* call = pool->head; call != NULL; call = call->next)
+            next = call->deadline < next ? call->deadline : next;
+    c->nextExpiry = next;
+}
+
+static int flush(fibConn* conn) {
+    while (conn->state == CONN_READY && conn->outOff < conn->outLen) {
+        const ssize_t n = send(conn->fd, conn->out + conn->outOff, conn->outLen - conn->outOff, MSG_NOSIGNAL);
+        if (n > 0)
+            conn->outOff += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    return 0;
+}
+
+// completes every whole response at the front of "in", -1 on a malformed one. one larger
+// than IN_MAX fails its call at once, asking again would bring the same answer.
+static int parseResponses(fibClient* c, fibConn* conn, int eof) {
+    while (conn->count > 0) {
+        const char* end = memmem(conn->in, conn->inLen, "\r\n\r\n", 4);
+        if (end == NULL)
+            return eof || conn->inLen == IN_MAX ? -1 : 0;
+        if (conn->inLen < 12 || strncmp(conn->in, "HTTP/1.", 7) != 0)
+            return -1;
+        const int status = atoi(conn->in + 9);
+        const size_t headLen = end + 4 - conn->in;
+        long bodyLen = -1;
+        for (const char* line = memchr(conn->in, '\n', headLen) + 1; line < end; line = memchr(line, '\n', end + 2 - line) + 1) {
+            if (strncasecmp(line, "Content-Length:", 15) == 0)
+                bodyLen = strtol(line + 15, NULL, 10);
+            else if (strncasecmp(line, "Connection:", 11) == 0 && strncasecmp(line + 11 + strspn(line + 11, " "), "close", 5) == 0)
+                conn->closing = 1;
+        }
+        if (bodyLen < 0) {
+            conn->closing = 1;  // the body runs until the server closes.
+            if (!eof)
+                return 0;
+            bodyLen = conn->inLen - headLen;
+        }
+        fibCall* call = conn->sent[conn->first];
+        if (connReserve(conn, headLen + bodyLen) < 0) {
+            conn->first = (conn->first + 1) % MAX_DEPTH;
+            conn->count--;
+            complete(c, call, FIB_ERROR, NULL, 0);
+            return -1;  // the rest of it is still on the wire.
+        }
+        if (conn->inLen < headLen + bodyLen)
+            return eof ? -1 : 0;
+        conn->first = (conn->first + 1) % MAX_DEPTH;
+        conn->count--;
+        complete(c, call, status == 200 ? FIB_OK : FIB_STATUS, conn->in + headLen, bodyLen);
+        conn->inLen -= headLen + bodyLen;
+        memmove(conn->in, conn->in + headLen + bodyLen, conn->inLen);
+    }
+    // a connection holds on to a big buffer only while a big response is on its way.
+    if (conn->inCap > IN_CAP && conn->inLen <= IN_CAP) {
+        char* in = realloc(conn->in, IN_CAP);
+        if (in != NULL) {
+            conn->in = in;
+            conn->inCap = IN_CAP;
+        }
+    }
+    return 0;
+}
+
+static void readConn(fibClient* c, fibConn* conn, long at) {
+    while (conn->state == CONN_READY) {
+        if (conn->inLen == conn->inCap && connReserve(conn, conn->inCap + 1) < 0) {
+            connDrop(c, conn, 1, at);  // a head that large is not an answer.
+            return;
+        }
+        const ssize_t n = recv(conn->fd, conn->in + conn->inLen, conn->inCap - conn->inLen, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n > 0)
+            conn->inLen += n;
+        if (parseResponses(c, conn, n <= 0) < 0 || n <= 0) {
+            // a clean close after the last answer costs nothing, anything else counts as a try.
+            connDrop(c, conn, conn->count > 0 && !(n == 0 && conn->closing), at);
+            return;
+        }
+        if (conn->closing && conn->count == 0) {
+            connDrop(c, conn, 0, at);
+            return;
+        }
+    }
+}
+
+static int runUntil(fibClient* c, long until, const int* done) {
+    while (c->active > 0 && (done == NULL || !*done)) {
+        long at = now();
+        expire(c, at);
+        int polled = 0;
+        for (fibPool* pool = c->pools; pool != NULL; pool = pool->next) {
+            dispatch(c, pool, at);
+            for (int i = 0; i < c->maxConns; i++) {
+                fibConn* conn = &pool->conns[i];
+                if (conn->state == CONN_CLOSED)
+                    continue;
+                if (flush(conn) < 0) {
+                    connDrop(c, conn, 1, at);
+                    continue;
+                }
+                const int writing = conn->state == CONN_CONNECTING || conn->outOff < conn->outLen;
+                c->pfds[polled] = (struct pollfd) { conn->fd, POLLIN | (writing ? POLLOUT : 0), 0 };
+                c->polled[polled++] = conn;
+            }
+        }
+        if (c->active == 0 || (done != NULL && *done) || (at = now()) >= until)
+            break;
+        const long wakeAt = until < c->nextExpiry ? until : c->nextExpiry;
+        const long waitMs = wakeAt == LONG_MAX ? -1 : wakeAt <= at ? 0 : (wakeAt - at) / 1000000 + 1;
+        if (poll(c->pfds, polled, waitMs > INT_MAX ? INT_MAX : (int) waitMs) < 0 && errno != EINTR)
+            return FIB_ERROR;
+        at = now();
+        for (int i = 0; i < polled; i++) {
+            fibConn* conn = c->polled[i];
+            const short revents = c->pfds[i].revents;
+            if (revents == 0 || conn->state == CONN_CLOSED || conn->fd != c->pfds[i].fd)
+                continue;
+            if (conn->state == CONN_CONNECTING) {
+                int err = 0;
+                socklen_t errLen = sizeof(err);
+                if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0 || err != 0) {
+                    connDrop(c, conn, 1, at);
+                    continue;
+                }
+                conn->state = CONN_READY;  // what queued up is written on the next round.
+            }
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+                readConn(c, conn, at);
+        }
+    }
+    return c->active;
+}
+
+// drives connections and calls for up to "timeoutMs" (all of them with a negative one), returns
+// how many calls are still pending.
+int fibClientRun(fibClient* c, int timeoutMs) {
+    return runUntil(c, timeoutMs < 0 ? LONG_MAX : now() + timeoutMs * 1000000L, NULL);
+}
+
+typedef struct {
+    int done;
+    int result;
+    char* digits;
+    size_t cap;
+    size_t len;
+} getResult;
+
+static void onGet(void* arg, int result, const char* digits, size_t len) {
+    getResult* gr = arg;
+    gr->done = 1;
+    gr->result = result;
+    if (result == FIB_OK) {
+        const size_t copied = len < gr->cap - 1 ? len : gr->cap - 1;
+        memcpy(gr->digits, digits, copied);
+        gr->digits[copied] = '\0';
+        gr->len = len;
+    }
+}
+
+// one blocking call through the pool, the digit count on success or a FIB_* error. as with
+// snprintf the count is the full one, "digits" holds only cap - 1 of them when it is cap or more.
+int fibClientGet(fibClient* c, const char* endpoint, int num, int timeoutMs, char* digits, size_t cap) {
+    if (cap == 0)
+        return FIB_INVALID;
+    getResult gr = { 0, FIB_ERROR, digits, cap, 0 };
+    const int submitted = fibClientSubmit(c, endpoint, num, timeoutMs, onGet, &gr);
+    if (submitted < 0)
+        return submitted;
+    while (!gr.done)
+        if (runUntil(c, LONG_MAX, &gr.done) < 0)
+            return FIB_ERROR;
+    return gr.result == FIB_OK ? (int) gr.len : gr.result;
+}
+
+// calls still pending are dropped without their callbacks.
+void fibClientFree(fibClient* c) {
+    for (fibPool* pool = c->pools; pool != NULL;) {
+        for (int i = 0; i < c->maxConns; i++) {
+            fibConn* conn = &pool->conns[i];
+            if (conn->state != CONN_CLOSED)
+                close(conn->fd);
+            free(conn->in);
+            for (int k = 0; k < conn->count; k++)
+                free(conn->sent[(conn->first + k) % MAX_DEPTH]);
+        }
+        for (fibCall* call = pool->head; call != NULL;) {
+            fibCall* next = call->next;
+            free(call);
+            call = next;
+        }
+        fibPool* next = pool->next;
+        free(pool);
+        pool = next;
+    }
+    for (fibCall* call = c->spare; call != NULL;) {
+        fibCall* next = call->next;
+        free(call);
+        call = next;
+    }
+    free(c->pfds);
+    free(c->polled);
+    free(c);
+}
@@ -0,0 +1,35 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// libfibclient: calls "/fib" on tiny-http-server over a per-host pool of keep-alive
+// connections, pipelining requests on each and failing every call that misses its deadline.
+// all I/O is non-blocking and driven by "fibClientRun" (or "fibClientGet"), a client is meant
+// for one thread; give every thread its own.
+//
+
+#ifndef THINKING_IN_C_FIBCLIENT_H
+#define THINKING_IN_C_FIBCLIENT_H
+
+#include <stddef.h>
+
+// what a call ends with.
+#define FIB_OK 0
+#define FIB_TIMEOUT -1  // the deadline passed first.
+#define FIB_ERROR -2  // could not connect, or the connection broke on every retry.
+#define FIB_STATUS -3  // the server answered, but not with 200.
+#define FIB_INVALID -4  // bad endpoint or arguments.
+
+// "digits" (not '\0'-terminated) is only valid during the call and only for FIB_OK.
+typedef void (*fibCallback)(void* arg, int result, const char* digits, size_t len);
+
+typedef struct fibClient fibClient;
+
+fibClient* fibClientNew(int, int);
+int fibClientSubmit(fibClient*, const char*, int, int, fibCallback, void*);
+int fibClientRun(fibClient*, int);
+// the digit count of F(num), or a FIB_* error. like snprintf, a count of "cap" or more means
+// "digits" was too small and holds only the first cap - 1 of them, '\0'-terminated.
+int fibClientGet(fibClient*, const char*, int, int, char*, size_t);
+void fibClientFree(fibClient*);
+
+#endif //THINKING_IN_C_FIBCLIENT_H
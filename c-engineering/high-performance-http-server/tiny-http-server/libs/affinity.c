@@ -0,0 +1,94 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "affinity.h"
+#include "structs.h"
+
+static cpu_set_t processCpus;
+
+// remembers the cpus the process may use before any thread gets pinned.
+void affinityInit(void) {
+    CPU_ZERO(&processCpus);
+    if (sched_getaffinity(0, sizeof(processCpus), &processCpus) < 0)
+        for (int i = 0; i < CPU_SETSIZE; i++)
+            CPU_SET(i, &processCpus);
+}
+
+// parses a cpu list such as "0-3,8,10-11", returns how many cpus were stored, -1 for a list
+// that is malformed, runs backwards, names a cpu outside the cpu_set_t or more than "max" of them.
+int affinityParse(const char* list, int* cpus, int max) {
+    int count = 0;
+    for (const char* p = list; p != NULL && *p != '\0';) {
+        char* end;
+        if (*p < '0' || *p > '9')
+            return -1;
+        const long first = strtol(p, &end, 10);
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            if (*p < '0' || *p > '9')
+                return -1;
+            last = strtol(p, &end, 10);
+        }
+        if (last < first || last >= CPU_SETSIZE || (*end != ',' && *end != '\0'))
+            return -1;
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (count == max)
+                return -1;
+            cpus[count++] = (int) cpu;
+        }
+        p = *end == ',' ? end + 1 : NULL;
+    }
+    return count;
+}
+
+int affinityPin(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+// lets a thread created by a pinned one float over all the process's cpus again.
+int affinityUnpin(void) {
+    return pthread_setaffinity_np(pthread_self(), sizeof(processCpus), &processCpus) == 0 ? 0 : -1;
+}
+
+// the NUMA node of the cpu the calling thread runs on, meaningful once it is pinned.
+int affinityCurrentNode(void) {
+    unsigned cpu, node;
+    return getcpu(&cpu, &node) == 0 ? (int) node : 0;
+}
+
+// a per-worker listener in the same SO_REUSEPORT group as the main one. SO_INCOMING_CPU makes
+// the kernel prefer it for connections whose packets were processed on "cpu", so with the NIC
+// queue's interrupt steered to that cpu a connection stays on one core from IRQ to response.
+int affinityShardListener(int cpu, int port, int backlog) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    const int on = 1;
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0
+        || setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0
+        || bind(fd, (sockaddr*) &address, sizeof(address)) < 0
+        || listen(fd, backlog) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,15 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_AFFINITY_H
+#define THINKING_IN_C_AFFINITY_H
+
+void affinityInit(void);
+int affinityParse(const char*, int*, int);
+int affinityPin(int);
+int affinityUnpin(void);
+int affinityCurrentNode(void);
+int affinityShardListener(int, int, int);
+
+#endif //THINKING_IN_C_AFFINITY_H
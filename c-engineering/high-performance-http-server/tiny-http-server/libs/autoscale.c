@@ -0,0 +1,180 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#define _GNU_SOURCE
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "autoscale.h"
+#include "macros.h"
+#include "stats.h"
+
+// workers report how long they spend outside epoll_wait, the controller turns that, the
+// listener's accept queue and the kernel's run-queue delay into grow/shrink decisions.
+typedef struct {
+    atomic_int tid;  // 0 while the slot is free.
+    atomic_llong busyNs;
+} workerSlot;
+
+static workerSlot slots[MAX_WORKER_THREADS];
+static _Thread_local int mySlot = -1;
+
+static int enabled = 0;
+static int listenFd = -1;
+static int minThreads, maxThreads;
+static atomic_int target;
+static atomic_int pendingRetire = 0;
+
+// controller-private.
+static int seenTid[MAX_WORKER_THREADS];
+static long long seenBusyNs[MAX_WORKER_THREADS];
+static long long seenRunDelayNs[MAX_WORKER_THREADS];
+static struct timespec lastStepAt;
+static int upStreak = 0, downStreak = 0;
+
+void autoscaleInit(const serverSettings* ss, int fd) {
+    listenFd = fd;
+    minThreads = ss->minThreads > 0 ? ss->minThreads : ss->threadCount;
+    maxThreads = ss->maxThreads > 0 ? ss->maxThreads : ss->threadCount;
+    if (maxThreads > MAX_WORKER_THREADS)
+        maxThreads = MAX_WORKER_THREADS;
+    if (minThreads > maxThreads)
+        minThreads = maxThreads;
+    int initial = ss->threadCount < minThreads ? minThreads : ss->threadCount > maxThreads ? maxThreads : ss->threadCount;
+    atomic_store(&target, initial);
+    enabled = minThreads < maxThreads;
+    clock_gettime(CLOCK_MONOTONIC, &lastStepAt);
+}
+
+int autoscaleEnabled(void) {
+    return enabled;
+}
+
+int autoscaleTarget(void) {
+    return atomic_load(&target);
+}
+
+// returns the worker's slot, which doubles as a stable index for cpu placement.
+int autoscaleRegister(void) {
+    const int tid = gettid();
+    for (int i = 0; i < MAX_WORKER_THREADS; i++) {
+        int free = 0;
+        if (atomic_load(&slots[i].tid) == 0 && atomic_compare_exchange_strong(&slots[i].tid, &free, -1)) {
+            atomic_store(&slots[i].busyNs, 0);
+            atomic_store(&slots[i].tid, tid);
+            mySlot = i;
+            return i;
+        }
+    }
+    return 0;
+}
+
+void autoscaleUnregister(void) {
+    if (mySlot >= 0)
+        atomic_store(&slots[mySlot].tid, 0);
+    mySlot = -1;
+}
+
+void autoscaleBusy(long ns) {
+    if (mySlot >= 0)
+        atomic_fetch_add_explicit(&slots[mySlot].busyNs, ns, memory_order_relaxed);
+}
+
+// a worker woken after a shrink claims one of the pending retirements.
+int autoscaleShouldRetire(void) {
+    int pending = atomic_load(&pendingRetire);
+    while (pending > 0)
+        if (atomic_compare_exchange_weak(&pendingRetire, &pending, pending - 1))
+            return 1;
+    return 0;
+}
+
+// time this thread spent runnable but waiting for a CPU, from the scheduler statistics.
+static long long runDelayNs(int tid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL)
+        return 0;
+    unsigned long long runNs = 0, waitNs = 0;
+    if (fscanf(fp, "%llu %llu", &runNs, &waitNs) != 2)
+        waitNs = 0;
+    fclose(fp);
+    return (long long) waitNs;
+}
+
+// for a listening socket the kernel reports the accept queue length as "unacked".
+static unsigned acceptQueueLength(void) {
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (listenFd < 0 || getsockopt(listenFd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+        return 0;
+    return info.tcpi_unacked;
+}
+
+// takes one sample and applies the hysteresis: several consecutive hot samples to grow,
+// more cold ones to shrink, and never grow while the CPUs are already saturated.
+// returns +1/-1 when the target changed, 0 otherwise.
+int autoscaleStep(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const long long elapsedNs = (now.tv_sec - lastStepAt.tv_sec) * 1000000000LL + (now.tv_nsec - lastStepAt.tv_nsec);
+    lastStepAt = now;
+
+    int workers = 0;
+    long long busyNs = 0, waitNs = 0;
+    for (int i = 0; i < MAX_WORKER_THREADS; i++) {
+        const int tid = atomic_load(&slots[i].tid);
+        if (tid <= 0) {
+            seenTid[i] = 0;
+            continue;
+        }
+        const long long busy = atomic_load_explicit(&slots[i].busyNs, memory_order_relaxed);
+        const long long wait = runDelayNs(tid);
+        if (seenTid[i] == tid) {
+            workers++;
+            busyNs += busy - seenBusyNs[i];
+            waitNs += wait - seenRunDelayNs[i];
+        }
+        seenTid[i] = tid;
+        seenBusyNs[i] = busy;
+        seenRunDelayNs[i] = wait;
+    }
+
+    autoscaleSample sample = { workers, atomic_load(&target), acceptQueueLength(), 0, 0 };
+    if (workers > 0 && elapsedNs > 0) {
+        sample.utilisation = (double) busyNs / ((double) elapsedNs * workers);
+        sample.runDelay = (double) waitNs / ((double) elapsedNs * workers);
+    }
+
+    const int saturated = sample.runDelay > SCALE_SATURATED_RUN_DELAY;
+    const int hot = sample.utilisation > SCALE_UP_UTILISATION || sample.queueLength > (unsigned) workers;
+    const int cold = sample.utilisation < SCALE_DOWN_UTILISATION && sample.queueLength == 0;
+    upStreak = hot && !saturated ? upStreak + 1 : 0;
+    downStreak = cold ? downStreak + 1 : 0;
+
+    int delta = 0;
+    if (upStreak >= SCALE_UP_SAMPLES && sample.target < maxThreads) {
+        delta = 1;
+        statsLocal()->scaleUps++;
+    } else if (downStreak >= SCALE_DOWN_SAMPLES && sample.target > minThreads) {
+        delta = -1;
+        atomic_fetch_add(&pendingRetire, 1);
+        statsLocal()->scaleDowns++;
+    }
+    if (delta != 0) {
+        upStreak = downStreak = 0;
+        atomic_fetch_add(&target, delta);
+        printf("[Info] Autoscale: workers %d -> %d (utilisation %.2f, queue %u, run delay %.2f).\n",
+               sample.target, sample.target + delta, sample.utilisation, sample.queueLength, sample.runDelay);
+        fflush(stdout);
+        sample.target += delta;
+        statsPublish();
+    }
+
+    statsPublishScale(&sample);  // what drove the decision, for "/stats" and SIGUSR1.
+    return delta;
+}
@@ -0,0 +1,19 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_AUTOSCALE_H
+#define THINKING_IN_C_AUTOSCALE_H
+
+#include "structs.h"
+
+void autoscaleInit(const serverSettings*, int);
+int autoscaleEnabled(void);
+int autoscaleTarget(void);
+int autoscaleRegister(void);
+void autoscaleUnregister(void);
+void autoscaleBusy(long);
+int autoscaleShouldRetire(void);
+int autoscaleStep(void);
+
+#endif //THINKING_IN_C_AUTOSCALE_H
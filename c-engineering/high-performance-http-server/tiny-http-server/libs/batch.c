@@ -0,0 +1,131 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// F(n) for a batch of n < BATCH_FIB_LIMIT at once. every lane runs the "__calcFibTCO" step
+// (x, y) -> (y, x + y) in 64 bits, as many times as the largest n of its group, and a lane
+// stops taking the step once its own n is reached.
+//
+#include <string.h>
+#include "batch.h"
+#include "macros.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86 1
+#endif
+
+typedef void (*batchKernel)(const int*, uint64_t*, size_t);
+
+static int maxOf(const int* n, size_t count) {
+    int most = 0;
+    for (size_t i = 0; i < count; i++)
+        most = n[i] > most ? n[i] : most;
+    return most;
+}
+
+static void batchScalar(const int* n, uint64_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t x = 0, y = 1;
+        for (int k = 0; k < n[i]; k++) {
+            const uint64_t t = x + y;
+            x = y;
+            y = t;
+        }
+        out[i] = x;
+    }
+}
+
+#ifdef BATCH_X86
+// 4 lanes per group, "k < n" selects the lanes that still step.
+__attribute__((target("avx2")))
+static void batchAVX2(const int* n, uint64_t* out, size_t count) {
+    for (; count >= 4; n += 4, out += 4, count -= 4) {
+        const __m256i limit = _mm256_setr_epi64x(n[0], n[1], n[2], n[3]);
+        __m256i x = _mm256_setzero_si256(), y = _mm256_set1_epi64x(1), k = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi64x(1);
+        for (int steps = maxOf(n, 4); steps > 0; steps--) {
+            const __m256i active = _mm256_cmpgt_epi64(limit, k);
+            const __m256i sum = _mm256_add_epi64(x, y);
+            x = _mm256_blendv_epi8(x, y, active);
+            y = _mm256_blendv_epi8(y, sum, active);
+            k = _mm256_add_epi64(k, one);
+        }
+        _mm256_storeu_si256((__m256i*) out, x);
+    }
+    batchScalar(n, out, count);
+}
+
+// 8 lanes per group with mask registers, a short tail runs masked instead of scalar.
+__attribute__((target("avx512f")))
+static void batchAVX512(const int* n, uint64_t* out, size_t count) {
+    const __m512i one = _mm512_set1_epi64(1);
+    for (; count > 0; n += 8, out += 8) {
+        const size_t lanes = count < 8 ? count : 8;
+        const __mmask8 valid = (__mmask8) ((1u << lanes) - 1);
+        int limits[8] = { 0 };
+        memcpy(limits, n, lanes * sizeof(int));
+        const __m512i limit = _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i*) limits));
+        __m512i x = _mm512_setzero_si512(), y = one, k = _mm512_setzero_si512();
+        for (int steps = maxOf(n, lanes); steps > 0; steps--) {
+            const __mmask8 active = _mm512_cmpgt_epi64_mask(limit, k);
+            const __m512i sum = _mm512_add_epi64(x, y);
+            x = _mm512_mask_mov_epi64(x, active, y);
+            y = _mm512_mask_mov_epi64(y, active, sum);
+            k = _mm512_add_epi64(k, one);
+        }
+        _mm512_mask_storeu_epi64(out, valid, x);
+        count -= lanes;
+    }
+}
+#endif
+
+static struct {
+    const char* name;
+    batchKernel kernel;
+} batchImpl = { "scalar", batchScalar };
+
+static int cpuSupports(const char* name) {
+#ifdef BATCH_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+// picks a kernel by name ("avx512", "avx2" or "scalar"), returns -1 if the CPU lacks it.
+int batchSelect(const char* name) {
+    if (!cpuSupports(name))
+        return -1;
+#ifdef BATCH_X86
+    if (strcmp(name, "avx512") == 0) {
+        batchImpl.name = "avx512";
+        batchImpl.kernel = batchAVX512;
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0) {
+        batchImpl.name = "avx2";
+        batchImpl.kernel = batchAVX2;
+        return 0;
+    }
+#endif
+    batchImpl.name = "scalar";
+    batchImpl.kernel = batchScalar;
+    return 0;
+}
+
+// runtime dispatch, must run before the workers start.
+void batchInit(void) {
+    if (batchSelect("avx512") < 0 && batchSelect("avx2") < 0)
+        batchSelect("scalar");
+}
+
+const char* batchImplName(void) {
+    return batchImpl.name;
+}
+
+// every n must be in [0, BATCH_FIB_LIMIT).
+void batchFib(const int* n, uint64_t* out, size_t count) {
+    batchImpl.kernel(n, out, count);
+}
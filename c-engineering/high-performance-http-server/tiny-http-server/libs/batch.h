@@ -0,0 +1,16 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_BATCH_H
+#define THINKING_IN_C_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void batchInit(void);
+int batchSelect(const char*);
+const char* batchImplName(void);
+void batchFib(const int*, uint64_t*, size_t);
+
+#endif //THINKING_IN_C_BATCH_H
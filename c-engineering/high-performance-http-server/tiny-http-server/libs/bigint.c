@@ -0,0 +1,595 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// F(n) for large n in decimal big integers: base 10^8 limbs, least significant first, so the
+// digits come out without a radix conversion. fast doubling needs one round per bit of n and
+// the three products of a round dominate, so "bigMul" picks schoolbook, Karatsuba, Toom-3 or
+// a number-theoretic transform by the size of the shorter operand. with a compute pool, the
+// products of a round and the halves of a large transform run on its threads.
+//
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bigint.h"
+#include "compute.h"
+#include "macros.h"
+
+typedef unsigned __int128 u128;
+
+// the transform works mod p = 29 * 2^57 + 1 on base 10^4 coefficients, whose products summed
+// over any length this server computes stay below p, so no CRT over several primes is needed.
+#define NTT_P 4179340454199820289ULL
+#define NTT_G 3
+#define NTT_BLOCK 4096  // transforms up to this length run in place without recursing.
+#define NTT_HALF_BASE 10000U
+
+static void mulAuto(uint32_t*, const uint32_t*, size_t, const uint32_t*, size_t);
+
+// ---- limb arithmetic, lengths may include leading zero limbs unless trimmed. ----
+
+static size_t trim(const uint32_t* a, size_t n) {
+    while (n > 0 && a[n - 1] == 0)
+        n--;
+    return n;
+}
+
+static int compare(const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    an = trim(a, an);
+    bn = trim(b, bn);
+    if (an != bn)
+        return an < bn ? -1 : 1;
+    while (an-- > 0)
+        if (a[an] != b[an])
+            return a[an] < b[an] ? -1 : 1;
+    return 0;
+}
+
+// r = a + b for an >= bn, returns an limbs and the carry out. r may be a or b.
+static uint32_t add(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    uint32_t carry = 0;
+    for (size_t i = 0; i < an; i++) {
+        const uint32_t s = a[i] + (i < bn ? b[i] : 0) + carry;
+        carry = s >= BIG_BASE;
+        r[i] = carry ? s - BIG_BASE : s;
+    }
+    return carry;
+}
+
+// r = a - b for a >= b, an limbs. r may be a or b.
+static void sub(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    uint32_t borrow = 0;
+    for (size_t i = 0; i < an; i++) {
+        const uint32_t y = (i < bn ? b[i] : 0) + borrow;
+        borrow = a[i] < y;
+        r[i] = borrow ? a[i] + BIG_BASE - y : a[i] - y;
+    }
+}
+
+// r[0, rn) += x[0, xn), the sum must fit in rn limbs.
+static void addInto(uint32_t* r, size_t rn, const uint32_t* x, size_t xn) {
+    uint32_t carry = add(r, r, xn, x, xn);
+    for (size_t i = xn; carry && i < rn; i++) {
+        r[i] += 1;
+        carry = r[i] == BIG_BASE;
+        if (carry)
+            r[i] = 0;
+    }
+}
+
+// ---- schoolbook and Karatsuba, both write an + bn limbs. ----
+
+static void mulSchoolbook(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    memset(r, 0, (an + bn) * sizeof(uint32_t));
+    for (size_t i = 0; i < an; i++) {
+        const uint64_t x = a[i];
+        uint64_t carry = 0;
+        for (size_t j = 0; j < bn; j++) {
+            const uint64_t t = r[i + j] + x * b[j] + carry;
+            r[i + j] = (uint32_t) (t % BIG_BASE);
+            carry = t / BIG_BASE;
+        }
+        r[i + bn] = (uint32_t) carry;
+    }
+}
+
+// a = a1 * B^m + a0 and the same for b: a0 * b0, a1 * b1 and (a0 + a1)(b0 + b1) minus both.
+// needs an >= bn > an / 2.
+static void mulKaratsuba(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    const size_t m = (an + 1) / 2, a1n = an - m, b1n = bn - m;
+    uint32_t* sa = malloc((4 * m + 4) * sizeof(uint32_t));
+    uint32_t* sb = sa + m + 1, * z1 = sb + m + 1;
+    sa[m] = add(sa, a, m, a + m, a1n);
+    sb[m] = add(sb, b, m, b + m, b1n);
+    mulAuto(z1, sa, m + 1, sb, m + 1);
+    mulAuto(r, a, m, b, m);
+    if (b1n > 0)
+        mulAuto(r + 2 * m, a + m, a1n, b + m, b1n);
+    else
+        memset(r + 2 * m, 0, (an + bn - 2 * m) * sizeof(uint32_t));
+    sub(z1, z1, 2 * m + 2, r, 2 * m);
+    sub(z1, z1, 2 * m + 2, r + 2 * m, an + bn - 2 * m);
+    addInto(r + m, an + bn - m, z1, trim(z1, 2 * m + 2));
+    free(sa);
+}
+
+// ---- Toom-3, on signed values since the evaluation at -1 and -2 and the interpolation
+// go negative along the way. ----
+
+typedef struct {
+    uint32_t* d;
+    size_t n;  // trimmed.
+    int neg;
+} signedBig;
+
+// z = x + y, or x - y with "subtract". z has room for max(x.n, y.n) + 1 limbs and may be x or y.
+static void signedAdd(signedBig* z, const signedBig* x, const signedBig* y, int subtract) {
+    const int yNeg = y->neg ^ subtract;
+    const signedBig* big = x, * small = y;
+    int neg = x->neg;
+    if (x->neg != yNeg && compare(x->d, x->n, y->d, y->n) < 0) {
+        big = y;
+        small = x;
+        neg = yNeg;
+    } else if (x->neg == yNeg && x->n < y->n) {
+        big = y;
+        small = x;
+    }
+    const size_t bigN = big->n, smallN = small->n;
+    if (x->neg == yNeg) {
+        z->d[bigN] = add(z->d, big->d, bigN, small->d, smallN);
+        z->n = trim(z->d, bigN + 1);
+    } else {
+        sub(z->d, big->d, bigN, small->d, smallN);
+        z->n = trim(z->d, bigN);
+    }
+    z->neg = z->n > 0 && neg;
+}
+
+// x /= d for a small d that divides it.
+static void signedDivide(signedBig* x, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = x->n; i-- > 0;) {
+        const uint64_t cur = rem * BIG_BASE + x->d[i];
+        x->d[i] = (uint32_t) (cur / d);
+        rem = cur % d;
+    }
+    x->n = trim(x->d, x->n);
+}
+
+static void signedMul(signedBig* z, const signedBig* x, const signedBig* y) {
+    if (x->n == 0 || y->n == 0) {
+        z->n = 0;
+        z->neg = 0;
+        return;
+    }
+    mulAuto(z->d, x->d, x->n, y->d, y->n);
+    z->n = trim(z->d, x->n + y->n);
+    z->neg = x->neg ^ y->neg;
+}
+
+// the pieces of a split at k limbs, evaluated at 0, 1, -1, -2 and infinity.
+static void toomEvaluate(const uint32_t* a, size_t an, size_t k, signedBig* at, uint32_t* space) {
+    signedBig p[3];
+    for (int i = 0; i < 3; i++) {
+        const size_t from = i * k < an ? i * k : an, to = (i + 1) * k < an ? (i + 1) * k : an;
+        p[i] = (signedBig) { (uint32_t*) a + from, trim(a + from, to - from), 0 };
+    }
+    at[0] = p[0];
+    at[4] = p[2];
+    for (int i = 1; i <= 3; i++)
+        at[i] = (signedBig) { space + (i - 1) * (k + 2), 0, 0 };
+    signedBig sum = { space + 3 * (k + 2), 0, 0 };
+    signedAdd(&sum, &p[0], &p[2], 0);
+    signedAdd(&at[1], &sum, &p[1], 0);  // p(1)
+    signedAdd(&at[2], &sum, &p[1], 1);  // p(-1)
+    signedAdd(&at[3], &at[2], &p[2], 0);
+    signedAdd(&at[3], &at[3], &at[3], 0);
+    signedAdd(&at[3], &at[3], &p[0], 1);  // p(-2) = 2 (p(-1) + a2) - a0
+}
+
+// Bodrato's interpolation sequence for the points 0, 1, -1, -2 and infinity.
+static void mulToom3(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    const size_t k = (an + 2) / 3, evalSize = k + 2, productSize = 2 * k + 6;
+    uint32_t* space = malloc((8 * evalSize + 5 * productSize) * sizeof(uint32_t));
+    signedBig pa[5], pb[5], w[5];
+    toomEvaluate(a, an, k, pa, space);
+    toomEvaluate(b, bn, k, pb, space + 4 * evalSize);
+    for (int i = 0; i < 5; i++) {
+        w[i] = (signedBig) { space + 8 * evalSize + i * productSize, 0, 0 };
+        signedMul(&w[i], &pa[i], &pb[i]);
+    }
+    // w = r(0), r(1), r(-1), r(-2), r(inf), turned into the coefficients r0, r1, r2, r3, r4.
+    signedAdd(&w[3], &w[3], &w[1], 1);
+    signedDivide(&w[3], 3);  // (r(-2) - r(1)) / 3
+    signedAdd(&w[1], &w[1], &w[2], 1);
+    signedDivide(&w[1], 2);  // (r(1) - r(-1)) / 2
+    signedAdd(&w[2], &w[2], &w[0], 1);  // r(-1) - r(0)
+    signedAdd(&w[3], &w[2], &w[3], 1);
+    signedDivide(&w[3], 2);
+    signedAdd(&w[3], &w[3], &w[4], 0);
+    signedAdd(&w[3], &w[3], &w[4], 0);  // r3
+    signedAdd(&w[2], &w[2], &w[1], 0);
+    signedAdd(&w[2], &w[2], &w[4], 1);  // r2
+    signedAdd(&w[1], &w[1], &w[3], 1);  // r1
+
+    memset(r, 0, (an + bn) * sizeof(uint32_t));
+    for (int i = 0; i < 5; i++)
+        if (w[i].n > 0)
+            addInto(r + i * k, an + bn - i * k, w[i].d, w[i].n);
+    free(space);
+}
+
+// ---- number-theoretic transform mod NTT_P. a twiddle w is kept with floor(w 2^64 / p)
+// (Shoup's trick), so multiplying by it takes a high half product instead of a division.
+// the pointwise products use Montgomery multiplication. ----
+
+static pthread_once_t nttOnce = PTHREAD_ONCE_INIT;
+static uint64_t nttNegInv;  // -p^-1 mod 2^64.
+static uint64_t nttR2;  // 2^128 mod p.
+static pthread_mutex_t rootsLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t* rootsTable = NULL;  // only grows, the tables it replaced stay valid.
+static atomic_size_t rootsLen = 0;  // published after the table.
+
+static void nttConstants(void) {
+    uint64_t inv = NTT_P;
+    for (int i = 0; i < 5; i++)
+        inv *= 2 - NTT_P * inv;
+    nttNegInv = -inv;
+    const uint64_t r = -NTT_P % NTT_P;
+    nttR2 = (uint64_t) ((u128) r * r % NTT_P);
+}
+
+static inline uint64_t mont(uint64_t a, uint64_t b) {
+    const u128 t = (u128) a * b;
+    const uint64_t q = (uint64_t) t * nttNegInv;
+    const uint64_t u = (uint64_t) ((t + (u128) q * NTT_P) >> 64);
+    return u >= NTT_P ? u - NTT_P : u;
+}
+
+// x w mod p, "shoup" being floor(w 2^64 / p).
+static inline uint64_t mulShoup(uint64_t x, uint64_t w, uint64_t shoup) {
+    const uint64_t q = (uint64_t) (((u128) x * shoup) >> 64);
+    const uint64_t r = x * w - q * NTT_P;
+    return r >= NTT_P ? r - NTT_P : r;
+}
+
+static inline uint64_t addP(uint64_t a, uint64_t b) {
+    const uint64_t s = a + b;
+    return s >= NTT_P ? s - NTT_P : s;
+}
+
+static inline uint64_t subP(uint64_t a, uint64_t b) {
+    return a >= b ? a - b : a + NTT_P - b;
+}
+
+// roots[2 (h + i)] = w_2h^i and roots[2 (h + i) + 1] its Shoup factor, for every power of two
+// h below "len". the layout does not depend on "len", so one table serves every shorter
+// transform and is only rebuilt to grow.
+static const uint64_t* nttRoots(size_t len) {
+    if (atomic_load_explicit(&rootsLen, memory_order_acquire) >= len)
+        return rootsTable;
+    pthread_mutex_lock(&rootsLock);
+    if (rootsLen < len) {
+        uint64_t* grown = malloc(2 * len * sizeof(uint64_t));
+        for (size_t h = 1; h < len; h *= 2) {
+            // w = g^((p - 1) / 2h), a primitive 2h-th root of unity, by square and multiply.
+            uint64_t w = mont(1, nttR2), power = mont(NTT_G, nttR2);
+            for (uint64_t e = (NTT_P - 1) / (2 * h); e > 0; e >>= 1) {
+                if (e & 1)
+                    w = mont(w, power);
+                power = mont(power, power);
+            }
+            w = mont(w, 1);  // out of Montgomery form.
+            const uint64_t wShoup = (uint64_t) (((u128) w << 64) / NTT_P);
+            for (size_t i = 0, x = 1; i < h; i++, x = mulShoup(x, w, wShoup)) {
+                grown[2 * (h + i)] = x;
+                grown[2 * (h + i) + 1] = (uint64_t) (((u128) x << 64) / NTT_P);
+            }
+        }
+        rootsTable = grown;
+        atomic_store_explicit(&rootsLen, len, memory_order_release);
+    }
+    pthread_mutex_unlock(&rootsLock);
+    return rootsTable;
+}
+
+typedef struct {
+    uint64_t* a;
+    size_t len;
+    const uint64_t* roots;
+    size_t from, to;  // the butterflies of a stage, or 0, 0 for a whole transform.
+} nttJob;
+
+// decimation in frequency: natural order in, bit-reversed order out.
+static void difButterflies(uint64_t* a, size_t h, const uint64_t* w, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++) {
+        const uint64_t u = a[i], v = a[i + h];
+        a[i] = addP(u, v);
+        a[i + h] = mulShoup(subP(u, v), w[2 * i], w[2 * i + 1]);
+    }
+}
+
+// decimation in time with the inverse twiddles, w_2h^-i = -w_2h^(h - i): bit-reversed in,
+// natural out.
+static void ditButterflies(uint64_t* a, size_t h, const uint64_t* w, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++) {
+        const uint64_t u = a[i];
+        if (i == 0) {
+            a[i] = addP(u, a[h]);
+            a[h] = subP(u, a[h]);
+            continue;
+        }
+        const uint64_t t = mulShoup(a[i + h], w[2 * (h - i)], w[2 * (h - i) + 1]);
+        a[i] = subP(u, t);
+        a[i + h] = addP(u, t);
+    }
+}
+
+static void nttForward(uint64_t* a, size_t len, const uint64_t* roots);
+static void nttInverse(uint64_t* a, size_t len, const uint64_t* roots);
+
+static void forwardTask(void* arg) {
+    const nttJob* j = arg;
+    if (j->to > j->from)
+        difButterflies(j->a, j->len / 2, j->roots + j->len, j->from, j->to);
+    else
+        nttForward(j->a, j->len, j->roots);
+}
+
+static void inverseTask(void* arg) {
+    const nttJob* j = arg;
+    if (j->to > j->from)
+        ditButterflies(j->a, j->len / 2, j->roots + j->len, j->from, j->to);
+    else
+        nttInverse(j->a, j->len, j->roots);
+}
+
+// a large transform's outer stage and then its two halves (the other way round for the
+// inverse) each go to the compute pool as two tasks.
+static void nttStage(uint64_t* a, size_t len, const uint64_t* roots, int forward) {
+    const size_t h = len / 2;
+    nttJob jobs[2] = { { a, len, roots, 0, h / 2 }, { a, len, roots, h / 2, h } };
+    const computeTask tasks[2] = {
+        { forward ? forwardTask : inverseTask, &jobs[0] }, { forward ? forwardTask : inverseTask, &jobs[1] }
+    };
+    computeRun(tasks, 2);
+}
+
+static void nttHalves(uint64_t* a, size_t len, const uint64_t* roots, int forward) {
+    const size_t h = len / 2;
+    nttJob jobs[2] = { { a, h, roots, 0, 0 }, { a + h, h, roots, 0, 0 } };
+    const computeTask tasks[2] = {
+        { forward ? forwardTask : inverseTask, &jobs[0] }, { forward ? forwardTask : inverseTask, &jobs[1] }
+    };
+    computeRun(tasks, 2);
+}
+
+static int nttParallel(size_t len) {
+    return computeThreads() > 0 && len >= 2 * BIG_PARALLEL_MIN;
+}
+
+static void nttForward(uint64_t* a, size_t len, const uint64_t* roots) {
+    if (len <= NTT_BLOCK) {
+        for (size_t h = len / 2; h >= 1; h /= 2)
+            for (size_t s = 0; s < len; s += 2 * h)
+                difButterflies(a + s, h, roots + 2 * h, 0, h);
+        return;
+    }
+    const size_t h = len / 2;
+    if (nttParallel(len)) {
+        nttStage(a, len, roots, 1);
+        nttHalves(a, len, roots, 1);
+    } else {
+        difButterflies(a, h, roots + 2 * h, 0, h);
+        nttForward(a, h, roots);
+        nttForward(a + h, h, roots);
+    }
+}
+
+static void nttInverse(uint64_t* a, size_t len, const uint64_t* roots) {
+    if (len <= NTT_BLOCK) {
+        for (size_t h = 1; h < len; h *= 2)
+            for (size_t s = 0; s < len; s += 2 * h)
+                ditButterflies(a + s, h, roots + 2 * h, 0, h);
+        return;
+    }
+    const size_t h = len / 2;
+    if (nttParallel(len)) {
+        nttHalves(a, len, roots, 0);
+        nttStage(a, len, roots, 0);
+    } else {
+        nttInverse(a, h, roots);
+        nttInverse(a + h, h, roots);
+        ditButterflies(a, h, roots + 2 * h, 0, h);
+    }
+}
+
+// each limb becomes two base 10^4 coefficients.
+static void nttLoad(uint64_t* f, size_t len, const uint32_t* a, size_t an) {
+    for (size_t i = 0; i < an; i++) {
+        f[2 * i] = a[i] % NTT_HALF_BASE;
+        f[2 * i + 1] = a[i] / NTT_HALF_BASE;
+    }
+    memset(f + 2 * an, 0, (len - 2 * an) * sizeof(uint64_t));
+}
+
+static void mulNTT(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    const int square = a == b && an == bn;
+    size_t len = 2;
+    while (len < 2 * (an + bn))
+        len <<= 1;
+    pthread_once(&nttOnce, nttConstants);
+    const uint64_t* roots = nttRoots(len);
+    uint64_t* fa = malloc((square ? 1 : 2) * len * sizeof(uint64_t)), * fb = square ? fa : fa + len;
+    nttLoad(fa, len, a, an);
+    if (square) {
+        nttForward(fa, len, roots);
+    } else {
+        nttLoad(fb, len, b, bn);
+        nttJob jobs[2] = { { fa, len, roots, 0, 0 }, { fb, len, roots, 0, 0 } };
+        const computeTask tasks[2] = { { forwardTask, &jobs[0] }, { forwardTask, &jobs[1] } };
+        if (nttParallel(len))
+            computeRun(tasks, 2);
+        else
+            for (int i = 0; i < 2; i++)
+                forwardTask(&jobs[i]);
+    }
+    // the pointwise product carries a 2^-64 from Montgomery, and the inverse a factor of len;
+    // both go with one multiplication by 2^128 / len in Montgomery form.
+    const uint64_t scale = mont(mont(NTT_P - (NTT_P - 1) / len, nttR2), nttR2);
+    for (size_t i = 0; i < len; i++)
+        fa[i] = mont(mont(fa[i], fb[i]), scale);
+    nttInverse(fa, len, roots);
+
+    uint64_t carry = 0;
+    for (size_t i = 0; i < an + bn; i++) {
+        const uint64_t lo = fa[2 * i] + carry;
+        const uint64_t hi = fa[2 * i + 1] + lo / NTT_HALF_BASE;
+        r[i] = (uint32_t) (lo % NTT_HALF_BASE + hi % NTT_HALF_BASE * NTT_HALF_BASE);
+        carry = hi / NTT_HALF_BASE;
+    }
+    free(fa);
+}
+
+// ---- dispatch. ----
+
+// a long operand against a short one goes in pieces of the short one's length.
+static void mulUnbalanced(int algo, uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    uint32_t* piece = malloc(2 * bn * sizeof(uint32_t));
+    memset(r, 0, (an + bn) * sizeof(uint32_t));
+    for (size_t at = 0; at < an; at += bn) {
+        const size_t n = an - at < bn ? an - at : bn;
+        bigMulWith(algo, piece, a + at, n, b, bn);
+        addInto(r + at, an + bn - at, piece, n + bn);
+    }
+    free(piece);
+}
+
+void bigMulWith(int algo, uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    if (an < bn) {
+        const uint32_t* t = a;
+        a = b;
+        b = t;
+        const size_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if (bn == 0) {
+        memset(r, 0, an * sizeof(uint32_t));
+        return;
+    }
+    if (algo == BIG_MUL_AUTO)
+        algo = bn < BIG_KARATSUBA_MIN ? BIG_MUL_SCHOOLBOOK : bn < BIG_TOOM3_MIN ? BIG_MUL_KARATSUBA
+             : bn < BIG_NTT_MIN ? BIG_MUL_TOOM3 : BIG_MUL_NTT;
+    if (algo == BIG_MUL_SCHOOLBOOK || bn == 1)
+        mulSchoolbook(r, a, an, b, bn);
+    else if (algo == BIG_MUL_NTT)
+        mulNTT(r, a, an, b, bn);  // any shape.
+    else if (2 * bn <= an)
+        mulUnbalanced(algo, r, a, an, b, bn);
+    else if (algo == BIG_MUL_KARATSUBA)
+        mulKaratsuba(r, a, an, b, bn);
+    else
+        mulToom3(r, a, an, b, bn);
+}
+
+static void mulAuto(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    bigMulWith(BIG_MUL_AUTO, r, a, an, b, bn);
+}
+
+// r = a * b in an + bn limbs, r must not overlap either.
+void bigMul(uint32_t* r, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    mulAuto(r, a, an, b, bn);
+}
+
+// ---- fast doubling. ----
+
+typedef struct {
+    uint32_t* r;
+    size_t* rn;
+    const uint32_t* a, * b;
+    size_t an, bn;
+} mulJob;
+
+static void mulTask(void* arg) {
+    const mulJob* j = arg;
+    bigMul(j->r, j->a, j->an, j->b, j->bn);
+    *j->rn = trim(j->r, j->an + j->bn);
+}
+
+// r = x + y, returns its trimmed length. r has room for one limb more than the longer and
+// may be x or y.
+static size_t addTrim(uint32_t* r, const uint32_t* x, size_t xn, const uint32_t* y, size_t yn) {
+    if (xn < yn) {
+        const uint32_t* t = x;
+        x = y;
+        y = t;
+        const size_t tn = xn;
+        xn = yn;
+        yn = tn;
+    }
+    r[xn] = add(r, x, xn, y, yn);
+    return trim(r, xn + 1);
+}
+
+// the decimal digits of F(n), n >= 0, in a string the caller frees. NULL without memory.
+char* bigFibDigits(long n, size_t* len) {
+    // F(n) has about n log10(phi) digits, the buffers take a product of two halves of it.
+    const size_t cap = 2 * ((size_t) (n * 0.20898764024997873 / BIG_BASE_DIGITS) + 4);
+    uint32_t* space = calloc(6 * cap, sizeof(uint32_t));
+    char* digits = malloc(cap * BIG_BASE_DIGITS + 1);
+    if (space == NULL || digits == NULL) {
+        free(space);
+        free(digits);
+        return NULL;
+    }
+    // (a, b) = (F(k), F(k + 1)) for the bits of n read so far, c = a (2b - a) and d = a^2 + b^2
+    // are the next pair. the four buffers rotate, s and t are scratch.
+    uint32_t* a = space, * b = a + cap, * c = b + cap, * d = c + cap, * s = d + cap, * t = s + cap;
+    size_t an = 0, bn = 1, cn, dn, sn, tn;
+    b[0] = 1;
+    for (int bit = n != 0 ? 63 - __builtin_clzl(n) : -1; bit >= 0; bit--) {
+        t[bn] = add(t, b, bn, b, bn);
+        sub(t, t, bn + 1, a, an);
+        tn = trim(t, bn + 1);
+        mulJob jobs[3] = { { c, &cn, a, t, an, tn }, { d, &dn, a, a, an, an }, { s, &sn, b, b, bn, bn } };
+        if (computeThreads() > 0 && bn >= BIG_PARALLEL_MIN) {
+            const computeTask tasks[3] = { { mulTask, &jobs[0] }, { mulTask, &jobs[1] }, { mulTask, &jobs[2] } };
+            computeRun(tasks, 3);
+        } else {
+            for (int i = 0; i < 3; i++)
+                mulTask(&jobs[i]);
+        }
+        dn = addTrim(d, d, dn, s, sn);
+        uint32_t* freeA = a, * freeB = b;
+        if ((n >> bit) & 1) {
+            cn = addTrim(c, c, cn, d, dn);
+            a = d;
+            an = dn;
+            b = c;
+            bn = cn;
+        } else {
+            a = c;
+            an = cn;
+            b = d;
+            bn = dn;
+        }
+        c = freeA;
+        d = freeB;
+    }
+    // the top limb without padding, the others with all 8 digits.
+    size_t at = (size_t) snprintf(digits, BIG_BASE_DIGITS + 1, "%u", an > 0 ? a[an - 1] : 0);
+    for (size_t i = an > 1 ? an - 1 : 0; i-- > 0; at += BIG_BASE_DIGITS) {
+        uint32_t limb = a[i];
+        for (int k = BIG_BASE_DIGITS - 1; k >= 0; k--) {
+            digits[at + k] = (char) ('0' + limb % 10);
+            limb /= 10;
+        }
+    }
+    digits[at] = '\0';
+    *len = at;
+    free(space);
+    return digits;
+}
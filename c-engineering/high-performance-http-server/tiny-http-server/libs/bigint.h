@@ -0,0 +1,22 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_BIGINT_H
+#define THINKING_IN_C_BIGINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the algorithm for the top level of a product, smaller ones below it always go by size.
+#define BIG_MUL_AUTO 0
+#define BIG_MUL_SCHOOLBOOK 1
+#define BIG_MUL_KARATSUBA 2
+#define BIG_MUL_TOOM3 3
+#define BIG_MUL_NTT 4
+
+void bigMul(uint32_t*, const uint32_t*, size_t, const uint32_t*, size_t);
+void bigMulWith(int, uint32_t*, const uint32_t*, size_t, const uint32_t*, size_t);
+char* bigFibDigits(long, size_t*);
+
+#endif //THINKING_IN_C_BIGINT_H
@@ -0,0 +1,63 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "capture.h"
+
+static int captureFd = -1;
+static uint64_t startNs = 0;
+static atomic_ullong capturedBytes = 0;
+
+static uint64_t wallNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// appends to an existing capture (keeping its start time) or starts a new one.
+int captureOpen(const char* path) {
+    if ((captureFd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0)
+        return -1;
+    captureHeader header;
+    if (pread(captureFd, &header, sizeof(header), 0) == sizeof(header)) {
+        if (memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0) {
+            close(captureFd);
+            captureFd = -1;
+            return -1;
+        }
+    } else {
+        memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        header.startNs = wallNanos();
+        if (ftruncate(captureFd, 0) < 0 || write(captureFd, &header, sizeof(header)) != sizeof(header)) {
+            close(captureFd);
+            captureFd = -1;
+            return -1;
+        }
+    }
+    startNs = header.startNs;
+    return 0;
+}
+
+// records the first "len" bytes held in "bc" (one request head, the pipelined ones behind it
+// are recorded in turn) as they arrived, up to CAPTURE_MAX_BYTES per run.
+void captureRequest(const bufChain* bc, size_t len) {
+    if (captureFd < 0 || atomic_fetch_add(&capturedBytes, len) + len > CAPTURE_MAX_BYTES)
+        return;
+    captureRecord rec = { wallNanos() - startNs, (uint32_t) len };
+    struct iovec iov[CAPTURE_MAX_SEGS + 1] = { { &rec, sizeof(rec) } };
+    int count = 1;
+    for (const bufSeg* seg = bc->head; seg != NULL && len > 0; seg = seg->next) {
+        if (count == CAPTURE_MAX_SEGS + 1)
+            return;  // an oversized head, not worth a second write that could interleave.
+        const size_t avail = seg->len - seg->start;
+        const size_t take = avail < len ? avail : len;
+        iov[count++] = (struct iovec) { (void*) (seg->data + seg->start), take };
+        len -= take;
+    }
+    writev(captureFd, iov, count);
+}
@@ -0,0 +1,31 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_CAPTURE_H
+#define THINKING_IN_C_CAPTURE_H
+
+#include <stdint.h>
+#include "structs.h"
+
+// file layout, read back by "replay":
+//   header: magic "FIBCAP01", wall-clock start in ns since the epoch.
+//   record: arrival in ns after the start, byte count, the raw request bytes.
+// workers append whole records with single writes, so records from different workers never
+// interleave but may be slightly out of arrival order.
+#define CAPTURE_MAGIC "FIBCAP01"
+
+typedef struct {
+    char magic[8];
+    uint64_t startNs;
+} captureHeader;
+
+typedef struct __attribute__((packed)) {
+    uint64_t offsetNs;
+    uint32_t len;
+} captureRecord;
+
+int captureOpen(const char*);
+void captureRequest(const bufChain*, size_t);
+
+#endif //THINKING_IN_C_CAPTURE_H
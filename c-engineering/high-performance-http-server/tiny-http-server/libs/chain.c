@@ -0,0 +1,273 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "chain.h"
+#include "http.h"
+#include "macros.h"
+#include "pool.h"
+#include "scan.h"
+
+void chainInit(bufChain* bc) {
+    bc->head = bc->tail = NULL;
+    bc->total = 0;
+}
+
+void chainRelease(bufChain* bc) {
+    for (bufSeg* seg = bc->head; seg != NULL;) {
+        bufSeg* next = seg->next;
+        poolFreeBuf(seg, seg->poolCap);
+        seg = next;
+    }
+    chainInit(bc);
+}
+
+// appends a new segment, each one twice the size of the last (up to the largest buffer class).
+static bufSeg* chainGrow(bufChain* bc) {
+    size_t want = bc->tail == NULL ? HTTP_REQ_BUF : bc->tail->poolCap * 2;
+    if (want > CHAIN_SEG_MAX)
+        want = CHAIN_SEG_MAX;
+    size_t poolCap;
+    bufSeg* seg = poolAllocBuf(want, &poolCap);
+    if (seg == NULL)
+        return NULL;
+    seg->next = NULL;
+    seg->poolCap = poolCap;
+    seg->cap = poolCap - sizeof(bufSeg) - 1;  // keep one byte for '\0'.
+    seg->len = 0;
+    seg->start = 0;
+    if (bc->tail == NULL)
+        bc->head = seg;
+    else
+        bc->tail->next = seg;
+    bc->tail = seg;
+    return seg;
+}
+
+// reads whatever the socket has into the tail of the chain, never moving what is already there.
+int chainFill(bufChain* bc, int fd, size_t limit) {
+    while (1) {
+        if (bc->total >= limit)
+            return CHAIN_LIMIT;
+        bufSeg* seg = bc->tail;
+        if (seg == NULL || seg->len == seg->cap) {
+            if ((seg = chainGrow(bc)) == NULL)
+                return CHAIN_ERROR;
+        }
+        size_t room = seg->cap - seg->len;
+        if (room > limit - bc->total)
+            room = limit - bc->total;
+        const ssize_t n = read(fd, seg->data + seg->len, room);
+        if (n > 0) {
+            seg->len += n;
+            seg->data[seg->len] = '\0';
+            bc->total += n;
+            if ((size_t) n < room)
+                return CHAIN_AGAIN;  // drained the socket for now.
+            continue;
+        }
+        if (n == 0)
+            return CHAIN_EOF;
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? CHAIN_AGAIN : CHAIN_ERROR;
+    }
+}
+
+void headParserInit(httpHeadParser* hp, bufChain* bc) {
+    hp->seg = bc->head;
+    hp->off = bc->head != NULL ? bc->head->start : 0;
+    hp->scanned = 0;
+    hp->lineEnd = 0;
+    hp->sinceNewline = 0;
+    hp->lastByte = '\0';
+}
+
+// resumes the scan for the blank line ending the head where the previous call stopped,
+// jumping from one '\n' to the next, returns 1 once it is found.
+int headParse(httpHeadParser* hp, bufChain* bc) {
+    if (hp->seg == NULL)
+        hp->seg = bc->head;
+    while (hp->seg != NULL) {
+        const bufSeg* seg = hp->seg;
+        const char* base = seg->data;
+        while (hp->off < seg->len) {
+            const char* from = base + hp->off;
+            const char* newline = scanDelims(from, base + seg->len, "\n");
+            const size_t skipped = newline - from;
+            if (newline == base + seg->len) {
+                hp->sinceNewline += skipped;
+                hp->scanned += skipped;
+                hp->lastByte = newline[-1];
+                hp->off = seg->len;
+                break;
+            }
+            const char prev = skipped > 0 ? newline[-1] : hp->lastByte;
+            hp->sinceNewline += skipped;
+            hp->scanned += skipped + 1;
+            hp->off += skipped + 1;
+            hp->lastByte = '\n';
+            if (hp->lineEnd == 0) {
+                hp->lineEnd = hp->scanned;
+            } else if (hp->sinceNewline == 0 || (hp->sinceNewline == 1 && prev == '\r')) {
+                return 1;  // an empty line, CRLF or bare LF.
+            }
+            hp->sinceNewline = 0;
+        }
+        if (seg->next == NULL)
+            break;  // wait for more bytes in this segment.
+        hp->seg = seg->next;
+        hp->off = 0;
+    }
+    return 0;
+}
+
+// the request line is nearly always inside the first segment and is handed out in place,
+// only a line that straddles segments gets assembled into a scratch buffer.
+char* headRequestLine(httpHeadParser* hp, bufChain* bc, size_t* len) {
+    const size_t n = *len = hp->lineEnd;
+    bufSeg* head = bc->head;
+    if (n <= head->len - head->start)
+        return head->data + head->start;
+    size_t scratchCap;
+    char* p = poolAllocBuf(n + 1, &scratchCap);
+    if (p == NULL)
+        return NULL;
+    size_t copied = 0;
+    for (const bufSeg* seg = head; copied < n; seg = seg->next) {
+        const size_t avail = seg->len - seg->start;
+        const size_t take = avail < n - copied ? avail : n - copied;
+        memcpy(p + copied, seg->data + seg->start, take);
+        copied += take;
+    }
+    p[copied] = '\0';
+    return p;
+}
+
+void headReleaseLine(bufChain* bc, char* line, size_t len) {
+    if (line != NULL && line != bc->head->data + bc->head->start)
+        poolFreeBuf(line, len + 1);
+}
+
+// starts on the header lines that follow the request line of the parsed head.
+void headCursorInit(httpHeadCursor* hc, const httpHeadParser* hp, const bufChain* bc) {
+    hc->seg = bc->head;
+    hc->off = bc->head->start;
+    hc->left = hp->scanned - hp->lineEnd;
+    hc->scratch = NULL;
+    hc->scratchCap = 0;
+    for (size_t skip = hp->lineEnd; skip > 0;) {
+        const size_t avail = hc->seg->len - hc->off;
+        if (skip < avail) {
+            hc->off += skip;
+            break;
+        }
+        skip -= avail;
+        hc->seg = hc->seg->next;
+        hc->off = 0;
+    }
+}
+
+// the line at the cursor straddles segments: assembles it, all "n" bytes up to its '\n', into
+// the cursor's scratch buffer, which the next call may reuse.
+static const char* headAssembleLine(httpHeadCursor* hc, size_t* len) {
+    size_t n = hc->seg->len - hc->off;
+    for (const bufSeg* seg = hc->seg->next; ; seg = seg->next) {
+        const char* end = memchr(seg->data, '\n', seg->len);  // the head ends with one.
+        if (end != NULL) {
+            n += end + 1 - seg->data;
+            break;
+        }
+        n += seg->len;
+    }
+    if (n + 1 > hc->scratchCap) {
+        headCursorRelease(hc);
+        if ((hc->scratch = poolAllocBuf(n + 1, &hc->scratchCap)) == NULL)
+            return NULL;
+    }
+    for (size_t copied = 0; copied < n;) {
+        if (hc->off == hc->seg->len) {
+            hc->seg = hc->seg->next;
+            hc->off = 0;
+        }
+        const size_t take = hc->seg->len - hc->off < n - copied ? hc->seg->len - hc->off : n - copied;
+        memcpy(hc->scratch + copied, hc->seg->data + hc->off, take);
+        copied += take;
+        hc->off += take;
+    }
+    hc->scratch[n] = '\0';
+    hc->left -= n;
+    *len = n;
+    return hc->scratch;
+}
+
+// parses the next header line into "name" and "value", 0 at the blank line closing the head
+// (or a malformed line, or without memory). a line is parsed where it lies, only one that
+// straddles segments is assembled first.
+int headNextField(httpHeadCursor* hc, strSpan* name, strSpan* value) {
+    if (hc->left == 0)
+        return 0;
+    while (hc->off == hc->seg->len) {
+        hc->seg = hc->seg->next;
+        hc->off = 0;
+    }
+    const char* from = hc->seg->data + hc->off;
+    const size_t avail = hc->seg->len - hc->off < hc->left ? hc->seg->len - hc->off : hc->left;
+    const char* next = httpNextHeader(from, from + avail, name, value);
+    if (next != NULL && next[-1] == '\n') {
+        hc->off += next - from;
+        hc->left -= next - from;
+        return 1;
+    }
+    if (next == NULL && memchr(from, '\n', avail) != NULL) {
+        hc->left = 0;
+        return 0;
+    }
+    size_t len;
+    const char* line = headAssembleLine(hc, &len);
+    return line != NULL && httpNextHeader(line, line + len, name, value) != NULL;
+}
+
+void headCursorRelease(httpHeadCursor* hc) {
+    if (hc->scratch != NULL)
+        poolFreeBuf(hc->scratch, hc->scratchCap);
+    hc->scratch = NULL;
+    hc->scratchCap = 0;
+}
+
+// copies "len" bytes onto the end of the chain, -1 if it ran out of buffers.
+int chainAppend(bufChain* bc, const char* p, size_t len) {
+    while (len > 0) {
+        bufSeg* seg = bc->tail;
+        if (seg == NULL || seg->len == seg->cap) {
+            if ((seg = chainGrow(bc)) == NULL)
+                return -1;
+        }
+        const size_t n = seg->cap - seg->len < len ? seg->cap - seg->len : len;
+        memcpy(seg->data + seg->len, p, n);
+        seg->len += n;
+        bc->total += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// drops the first "n" bytes. the head segment only moves its start past them, so a pipelined
+// request behind them is parsed where it lies instead of being moved to the front.
+void chainConsume(bufChain* bc, size_t n) {
+    if (n >= bc->total) {
+        chainRelease(bc);  // an idle connection holds no buffers.
+        return;
+    }
+    bc->total -= n;
+    while (n >= bc->head->len - bc->head->start) {
+        bufSeg* seg = bc->head;
+        n -= seg->len - seg->start;
+        bc->head = seg->next;
+        poolFreeBuf(seg, seg->poolCap);
+    }
+    bc->head->start += n;
+}
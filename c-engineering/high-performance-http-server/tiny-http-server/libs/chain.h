@@ -0,0 +1,29 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_CHAIN_H
+#define THINKING_IN_C_CHAIN_H
+
+#include "structs.h"
+
+// results of "chainFill".
+#define CHAIN_AGAIN 0
+#define CHAIN_EOF -1
+#define CHAIN_ERROR -2
+#define CHAIN_LIMIT -3
+
+void chainInit(bufChain*);
+void chainRelease(bufChain*);
+int chainFill(bufChain*, int, size_t);
+int chainAppend(bufChain*, const char*, size_t);
+void headParserInit(httpHeadParser*, bufChain*);
+int headParse(httpHeadParser*, bufChain*);
+char* headRequestLine(httpHeadParser*, bufChain*, size_t*);
+void headReleaseLine(bufChain*, char*, size_t);
+void headCursorInit(httpHeadCursor*, const httpHeadParser*, const bufChain*);
+int headNextField(httpHeadCursor*, strSpan*, strSpan*);
+void headCursorRelease(httpHeadCursor*);
+void chainConsume(bufChain*, size_t);
+
+#endif //THINKING_IN_C_CHAIN_H
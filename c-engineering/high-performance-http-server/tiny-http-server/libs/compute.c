@@ -0,0 +1,99 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// the compute pool: helper threads that split up one large computation, such as a
+// big-integer multiplication, while the event loops stay with their connections.
+// "computeRun" queues all tasks but the first, runs that one itself and then helps with
+// whatever is queued until its own are done, so a task may call "computeRun" again without
+// deadlocking. with no helpers, or a full queue, tasks run on the caller.
+//
+#include <pthread.h>
+#include <stdio.h>
+#include "compute.h"
+#include "macros.h"
+
+typedef struct {
+    const computeTask* task;
+    int* pending;  // the caller's count of unfinished tasks, under "lock".
+} queuedTask;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;  // a task was queued or finished.
+static queuedTask queue[COMPUTE_QUEUE];
+static size_t queueHead = 0, queueCount = 0;
+static int helpers = 0;
+static int started = 0;  // helpers are started on first use, in prefork mode after the fork.
+
+static void* computeHelper(void* arg);
+
+void computeInit(int threads) {
+    helpers = threads < 0 ? 0 : threads > COMPUTE_MAX_THREADS ? COMPUTE_MAX_THREADS : threads;
+}
+
+int computeThreads(void) {
+    return helpers;
+}
+
+// takes the oldest queued task and runs it, called with "lock" held and returns with it held.
+static void runQueued(void) {
+    const queuedTask q = queue[queueHead];
+    queueHead = (queueHead + 1) % COMPUTE_QUEUE;
+    queueCount--;
+    pthread_mutex_unlock(&lock);
+    q.task->fn(q.task->arg);
+    pthread_mutex_lock(&lock);
+    if (--*q.pending == 0)
+        pthread_cond_broadcast(&changed);
+}
+
+static void* computeHelper(void* arg) {
+    (void) arg;
+    pthread_mutex_lock(&lock);
+    while (1) {
+        while (queueCount == 0)
+            pthread_cond_wait(&changed, &lock);
+        runQueued();
+    }
+    return NULL;
+}
+
+static void startHelpers(void) {
+    for (int i = 0; i < helpers; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, computeHelper, NULL) != 0) {
+            fprintf(stderr, "[Warn] Compute pool started with %d of %d threads.\n", i, helpers);
+            helpers = i;
+            break;
+        }
+        pthread_detach(tid);
+    }
+    started = 1;
+}
+
+void computeRun(const computeTask* tasks, int count) {
+    int pending = 0, queued = 1;
+    pthread_mutex_lock(&lock);
+    if (helpers > 0 && !started)
+        startHelpers();
+    for (; helpers > 0 && queued < count && queueCount < COMPUTE_QUEUE; queued++) {
+        queue[(queueHead + queueCount++) % COMPUTE_QUEUE] = (queuedTask) { &tasks[queued], &pending };
+        pending++;
+    }
+    if (pending > 0)
+        pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+
+    if (count > 0)
+        tasks[0].fn(tasks[0].arg);
+    for (int i = queued; i < count; i++)  // the ones that did not fit the queue.
+        tasks[i].fn(tasks[i].arg);
+
+    pthread_mutex_lock(&lock);
+    while (pending > 0) {
+        if (queueCount > 0)
+            runQueued();
+        else
+            pthread_cond_wait(&changed, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
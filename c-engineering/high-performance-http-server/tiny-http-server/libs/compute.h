@@ -0,0 +1,14 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_COMPUTE_H
+#define THINKING_IN_C_COMPUTE_H
+
+#include "structs.h"
+
+void computeInit(int);
+int computeThreads(void);
+void computeRun(const computeTask*, int);
+
+#endif //THINKING_IN_C_COMPUTE_H
@@ -0,0 +1,100 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// overload degradation: every worker keeps a smoothed estimate of how long requests wait
+// before it gets to them. while that is above "degrade_queue_us", a value that would have to
+// be computed is estimated with Binet's formula, F(n) ~ phi^n / sqrt(5), instead, as long as
+// the estimate's error bound is within "degrade_tolerance".
+//
+#define _GNU_SOURCE
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include "degrade.h"
+#include "macros.h"
+
+#define PHI 1.6180339887498949
+#define SQRT5 2.2360679774997898
+#define LOG10_PHI 0.20898764024997873
+#define LOG10_SQRT5 0.34948500216800940
+
+static long queueLimitNanos = 0;  // 0 keeps every answer exact.
+static double tolerance = DEGRADE_TOLERANCE;
+// per worker, in monotonic ns.
+static _Thread_local long readyFrom = 0;  // since when the requests of this wakeup may have waited.
+static _Thread_local long wokeAt = 0;
+static _Thread_local long smoothedNanos = 0;
+static _Thread_local int overloaded = 0;
+
+void degradeInit(const serverSettings* ss) {
+    queueLimitNanos = ss->degradeQueueMicros * 1000;
+    tolerance = ss->degradeTolerance;
+}
+
+int degradeEnabled(void) {
+    return queueLimitNanos > 0;
+}
+
+static long toNanos(const struct timespec* ts) {
+    return ts->tv_sec * 1000000000L + ts->tv_nsec;
+}
+
+// the event loop woke up at "at". events that were already pending ("queued") came in while
+// it was busy with the last wakeup, the others arrived while it waited.
+void degradeWakeup(const struct timespec* at, int queued) {
+    const long now = toNanos(at);
+    readyFrom = queued && wokeAt != 0 ? wokeAt : now;
+    wokeAt = now;
+}
+
+// takes the queue time of a request that is about to be computed as a sample and tells
+// whether this worker is overloaded. the half-way exit keeps it from flapping.
+int degradeOverloaded(void) {
+    if (queueLimitNanos <= 0 || readyFrom == 0)
+        return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    smoothedNanos += (toNanos(&ts) - readyFrom - smoothedNanos) / DEGRADE_SMOOTHING;
+    if (!overloaded && smoothedNanos >= queueLimitNanos)
+        overloaded = 1;
+    else if (overloaded && smoothedNanos < queueLimitNanos / 2)
+        overloaded = 0;
+    return overloaded;
+}
+
+// writes an estimate of F(n) and its relative error bound, 0 if that bound is above the
+// tolerance or it does not fit. a value below 10^15 is written whole, rounded, which makes it
+// exact for small n; a larger one as "<mantissa>e<exponent>".
+size_t degradeFibApprox(long n, char* out, size_t cap, double* error) {
+    if (n < 0)
+        return 0;
+    const double exponent = n * LOG10_PHI - LOG10_SQRT5;  // log10 of the estimate.
+    int len;
+    if (exponent < 15) {
+        // pow() is off by about one ulp per factor of phi, the dropped (-1/phi)^n / sqrt(5)
+        // term by less than 0.45.
+        const double estimate = pow(PHI, (double) n) / SQRT5;
+        const double rounded = nearbyint(estimate);
+        const double off = estimate * (n + 3) * DBL_EPSILON + 0.45;
+        *error = off < 0.5 ? 0 : (off + 0.5) / (rounded > 1 ? rounded : 1);
+        len = snprintf(out, cap, "%.0f", rounded);
+    } else {
+        // log10 carries an absolute error of about its magnitude in ulps, which 10^x turns
+        // into a relative one ln(10) times as large. one digit past what that leaves keeps
+        // the rounding of the mantissa small next to it.
+        const double bound = M_LN10 * (exponent + 2) * DBL_EPSILON + 4 * DBL_EPSILON;
+        const int digits = (int) fmin(ceil(-log10(bound)) + 1, 17);
+        const double scale = pow(10, digits - 1);
+        long whole = (long) exponent;
+        double mantissa = nearbyint(pow(10, exponent - whole) * scale) / scale;
+        if (mantissa >= 10) {
+            mantissa /= 10;
+            whole++;
+        }
+        *error = bound + 0.5 / scale;
+        len = snprintf(out, cap, "%.*fe%ld", digits - 1, mantissa, whole);
+    }
+    if (*error > tolerance || len < 0 || (size_t) len >= cap)
+        return 0;
+    return len;
+}
@@ -0,0 +1,18 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_DEGRADE_H
+#define THINKING_IN_C_DEGRADE_H
+
+#include <stddef.h>
+#include <time.h>
+#include "structs.h"
+
+void degradeInit(const serverSettings*);
+int degradeEnabled(void);
+void degradeWakeup(const struct timespec*, int);
+int degradeOverloaded(void);
+size_t degradeFibApprox(long, char*, size_t, double*);
+
+#endif //THINKING_IN_C_DEGRADE_H
@@ -0,0 +1,149 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "batch.h"
+#include "bigint.h"
+#include "compute.h"
+#include "degrade.h"
+#include "engine.h"
+#include "fibmod.h"
+#include "helpers.h"
+#include "macros.h"
+#include "memo.h"
+#include "plugin.h"
+#include "store.h"
+
+static long storeMinMicros = 0;
+static int batching = 0;
+static long maxNum = MAX_NUM;
+static _Thread_local char* bigDigits = NULL;  // this thread's last big value, valid until its next one.
+
+void engineInit(const serverSettings* ss) {
+    storeMinMicros = ss->storeMinMicros;
+    batching = ss->batch > 0;
+    maxNum = ss->maxNum;
+    computeInit(ss->computeThreads);
+    degradeInit(ss);
+}
+
+static long elapsedMicros(const struct timespec* from) {
+    struct timespec to;
+    clock_gettime(CLOCK_MONOTONIC, &to);
+    return (to.tv_sec - from->tv_sec) * 1000000L + (to.tv_nsec - from->tv_nsec) / 1000;
+}
+
+// F(n) from the plugin, in "scratch" when it fits and otherwise in this thread's big buffer,
+// sized first by the bound on F(n)'s digits and then by the count the plugin reports. -1 when
+// the plugin leaves n to the built-in kernel, -2 when there is no memory for the digits.
+static long pluginFibDigits(long n, char* scratch, size_t scratchCap, const char** digits) {
+    const computePlugin* plugin = pluginAcquire();
+    long len = -1;
+    if (plugin == NULL || plugin->fibDigits == NULL || n < 0) {
+        pluginRelease(plugin);
+        return -1;
+    }
+    char* buf = scratch;
+    size_t cap = scratchCap;
+    size_t need = (size_t) (n * 0.20898764024997873) + 2;  // n log10(phi) + 1 digits, and the NUL.
+    for (int tries = 0; tries < 2; tries++) {
+        if (need > cap) {
+            free(bigDigits);
+            if ((bigDigits = malloc(need)) == NULL) {
+                len = -2;
+                break;
+            }
+            buf = bigDigits;
+            cap = need;
+        }
+        if ((len = plugin->fibDigits(n, buf, cap)) < 0 || (size_t) len < cap)
+            break;
+        need = (size_t) len + 1;
+        len = -1;  // still short after the plugin's own count, so it is not to be trusted.
+    }
+    pluginRelease(plugin);
+    if (len >= 0)
+        *digits = buf;
+    return len;
+}
+
+// returns the decimal digits of F(n), either in place from the memo or the store, or computed
+// into "scratch" (a big value into a per-thread buffer). values that were slow to compute are
+// persisted. an overloaded worker writes an estimate into "scratch" instead and sets "error"
+// to its relative error bound, which stays -1 for an exact value. NULL when n is above
+// "max_num" or there is no memory for its digits.
+const char* engineFibDigits(long n, char* scratch, size_t scratchCap, size_t* len, double* error) {
+    *error = -1;
+    if (n > maxNum)
+        return NULL;
+    const char* digits;
+    if ((digits = memoGet(n, len)) != NULL)
+        return digits;
+    if ((digits = storeGet(n, len)) != NULL) {
+        memoPut(n, digits, *len);
+        return digits;
+    }
+    // an estimate is never memoised, the next request past the overload gets the exact value.
+    if (degradeOverloaded() && (*len = degradeFibApprox(n, scratch, scratchCap, error)) > 0)
+        return scratch;
+    *error = -1;  // out of tolerance, computed after all.
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // a loaded plugin computes what it can, the built-in kernel does the rest.
+    digits = scratch;
+    const long pluginLen = pluginFibDigits(n, scratch, scratchCap, &digits);
+    if (pluginLen == -2)
+        return NULL;
+    if (pluginLen >= 0) {
+        *len = pluginLen;
+    } else if (batching && n >= 0 && n < BATCH_FIB_LIMIT) {
+        // the batch kernel with one lane, so a value never depends on whether it was batched.
+        const int k = (int) n;
+        uint64_t value;
+        batchFib(&k, &value, 1);
+        *len = snprintf(scratch, scratchCap, "%llu", (unsigned long long) value);
+    } else if (n <= FIB_INT_MAX) {
+        *len = snprintf(scratch, scratchCap, "%d", calcFibonacci((int) n));
+    } else {
+        // past what an int holds, fast doubling over big integers.
+        free(bigDigits);
+        if ((bigDigits = bigFibDigits(n, len)) == NULL)
+            return NULL;
+        digits = bigDigits;
+    }
+    memoPut(n, digits, *len);
+    if (elapsedMicros(&start) >= storeMinMicros)
+        storePut(n, digits, *len);
+    return digits;
+}
+
+// whether "n" is worth holding back for a micro-batch: the built-in kernel would compute it
+// and nothing has it ready.
+int engineBatchable(long n) {
+    size_t len;
+    return batching && n >= 0 && n < BATCH_FIB_LIMIT && pluginActive() == NULL
+        && memoGet(n, &len) == NULL && storeGet(n, &len) == NULL;
+}
+
+// the digits of F(n[i]) for a whole micro-batch, computed lane by lane in one kernel call.
+void engineFibBatch(const int* n, size_t count, char (*digits)[BATCH_DIGITS], size_t* lens) {
+    uint64_t values[BATCH_MAX];
+    batchFib(n, values, count);
+    for (size_t i = 0; i < count; i++) {
+        lens[i] = snprintf(digits[i], BATCH_DIGITS, "%llu", (unsigned long long) values[i]);
+        memoPut(n[i], digits[i], lens[i]);
+    }
+}
+
+// F(n) mod m from the plugin when it has a kernel for it, otherwise from the built-in one.
+int engineFibMod(uint64_t n, uint64_t m, uint64_t* residue) {
+    if (m == 0)
+        return -1;
+    const computePlugin* plugin = pluginAcquire();
+    const int result = plugin != NULL && plugin->fibMod != NULL ? plugin->fibMod(n, m, residue) : -1;
+    pluginRelease(plugin);
+    return result == 0 ? 0 : fibMod(n, m, residue);
+}
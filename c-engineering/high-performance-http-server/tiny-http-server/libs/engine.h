@@ -0,0 +1,19 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_ENGINE_H
+#define THINKING_IN_C_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "macros.h"
+#include "structs.h"
+
+void engineInit(const serverSettings*);
+const char* engineFibDigits(long, char*, size_t, size_t*, double*);
+int engineBatchable(long);
+void engineFibBatch(const int*, size_t, char (*)[BATCH_DIGITS], size_t*);
+int engineFibMod(uint64_t, uint64_t, uint64_t*);
+
+#endif //THINKING_IN_C_ENGINE_H
@@ -0,0 +1,115 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// F(n) mod m for any 64-bit n and m by fast doubling, which takes one step per bit of n:
+//   F(2k) = F(k) * (2 * F(k + 1) - F(k)),  F(2k + 1) = F(k)^2 + F(k + 1)^2.
+// products are reduced without dividing. m = 2^s * o is split: the odd o goes through
+// Montgomery multiplication, 2^s is what 64-bit arithmetic wraps at anyway, and the two
+// residues are joined by the chinese remainder theorem. for a small m, n is first reduced by
+// the Pisano period (F mod m repeats with it), and the periods found are kept for later requests.
+//
+#include <stdatomic.h>
+#include "fibmod.h"
+#include "macros.h"
+
+typedef unsigned __int128 u128;
+
+typedef struct {
+    uint64_t m;  // odd.
+    uint64_t inv;  // m^-1 mod 2^64.
+    uint64_t one;  // 2^64 mod m, 1 in Montgomery form.
+} montgomery;
+
+static _Atomic uint32_t pisanoPeriods[PISANO_MAX + 1];  // 0 while not computed yet.
+
+static void montgomeryInit(montgomery* mg, uint64_t m) {
+    // newton's iteration doubles the correct low bits of the inverse each round.
+    uint64_t inv = m;
+    for (int i = 0; i < 5; i++)
+        inv *= 2 - m * inv;
+    mg->m = m;
+    mg->inv = inv;
+    mg->one = -m % m;
+}
+
+// t * 2^-64 mod m for t < m * 2^64, written so that nothing overflows even when m is close to 2^64.
+static uint64_t redc(const montgomery* mg, u128 t) {
+    const uint64_t lo = (uint64_t) t, hi = t >> 64;
+    const uint64_t q = -(lo * mg->inv);
+    // lo + low(q * m) is 0 mod 2^64, and carries exactly when lo is not 0.
+    const u128 r = (u128) hi + (uint64_t) (((u128) q * mg->m) >> 64) + (lo != 0);
+    return r >= mg->m ? (uint64_t) (r - mg->m) : (uint64_t) r;
+}
+
+static uint64_t mulMod(const montgomery* mg, uint64_t a, uint64_t b) {
+    return redc(mg, (u128) a * b);
+}
+
+static uint64_t addMod(uint64_t a, uint64_t b, uint64_t m) {
+    const uint64_t s = a + b;
+    return s < a || s >= m ? s - m : s;
+}
+
+static uint64_t subMod(uint64_t a, uint64_t b, uint64_t m) {
+    return a >= b ? a - b : a - b + m;
+}
+
+// the period of F mod m, by walking the sequence until it is back at 0, 1. it is at most 6m.
+uint64_t fibModPisano(uint64_t m) {
+    if (m <= PISANO_MAX) {
+        const uint32_t known = atomic_load_explicit(&pisanoPeriods[m], memory_order_relaxed);
+        if (known != 0)
+            return known;
+    }
+    uint64_t period = 1;
+    if (m > 1) {
+        uint64_t x = 0, y = 1;
+        do {
+            const uint64_t t = addMod(x, y, m);
+            x = y;
+            y = t;
+            period++;
+        } while (x != 0 || y != 1);
+        period--;
+    }
+    // a racing thread stores the same value.
+    if (m <= PISANO_MAX)
+        atomic_store_explicit(&pisanoPeriods[m], (uint32_t) period, memory_order_relaxed);
+    return period;
+}
+
+// returns -1 for m = 0, otherwise F(n) mod m in "out".
+int fibMod(uint64_t n, uint64_t m, uint64_t* out) {
+    if (m == 0)
+        return -1;
+    if (m <= PISANO_MAX)
+        n %= fibModPisano(m);
+    const int shift = __builtin_ctzll(m);
+    montgomery mg;
+    montgomeryInit(&mg, m >> shift);
+    const uint64_t o = mg.m;
+
+    // (a, b) = (F(k), F(k + 1)) mod o in Montgomery form and (x, y) the same mod 2^64, for
+    // the bits of n read so far. the two chains are independent, so they overlap.
+    uint64_t a = 0, b = mg.one, x = 0, y = 1;
+    for (int bit = n != 0 ? 63 - __builtin_clzll(n) : -1; bit >= 0; bit--) {
+        const uint64_t c = mulMod(&mg, a, subMod(addMod(b, b, o), a, o));
+        const uint64_t d = addMod(mulMod(&mg, a, a), mulMod(&mg, b, b), o);
+        const uint64_t z = x * (2 * y - x), w = x * x + y * y;
+        if ((n >> bit) & 1) {
+            a = d;
+            b = addMod(c, d, o);
+            x = w;
+            y = z + w;
+        } else {
+            a = c;
+            b = d;
+            x = z;
+            y = w;
+        }
+    }
+    // the r below o * 2^s = m with r = F(n) mod o and r = x mod 2^s, as shift < 64.
+    const uint64_t odd = redc(&mg, a);
+    *out = odd + o * (((x - odd) * mg.inv) & ((1ULL << shift) - 1));
+    return 0;
+}
@@ -0,0 +1,13 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_FIBMOD_H
+#define THINKING_IN_C_FIBMOD_H
+
+#include <stdint.h>
+
+int fibMod(uint64_t, uint64_t, uint64_t*);
+uint64_t fibModPisano(uint64_t);
+
+#endif //THINKING_IN_C_FIBMOD_H
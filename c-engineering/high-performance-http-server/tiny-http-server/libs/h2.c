@@ -0,0 +1,723 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// cleartext HTTP/2 (RFC 9113) over a connection the worker already owns, either opened with
+// the preface ("prior knowledge") or upgraded from an HTTP/1.1 request. requests are answered
+// as soon as their stream ends, like HTTP/1.1 ones; what multiplexing adds is that the bodies
+// of many responses share the connection, one DATA frame per stream in turn while the flow
+// control windows allow, and a stream only stays open while its body waits for window.
+//
+#include <sys/socket.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "h2.h"
+#include "hpack.h"
+#include "static.h"
+#include "stats.h"
+
+// frame types.
+#define FRAME_DATA 0x0
+#define FRAME_HEADERS 0x1
+#define FRAME_PRIORITY 0x2
+#define FRAME_RST_STREAM 0x3
+#define FRAME_SETTINGS 0x4
+#define FRAME_PUSH_PROMISE 0x5
+#define FRAME_PING 0x6
+#define FRAME_GOAWAY 0x7
+#define FRAME_WINDOW_UPDATE 0x8
+#define FRAME_CONTINUATION 0x9
+
+// frame flags.
+#define FLAG_END_STREAM 0x1
+#define FLAG_ACK 0x1
+#define FLAG_END_HEADERS 0x4
+#define FLAG_PADDED 0x8
+#define FLAG_PRIORITY 0x20
+
+// error codes.
+#define ERR_NONE 0x0
+#define ERR_PROTOCOL 0x1
+#define ERR_INTERNAL 0x2
+#define ERR_FLOW_CONTROL 0x3
+#define ERR_STREAM_CLOSED 0x5
+#define ERR_FRAME_SIZE 0x6
+#define ERR_REFUSED_STREAM 0x7
+#define ERR_COMPRESSION 0x9
+#define ERR_ENHANCE_YOUR_CALM 0xb
+
+// settings.
+#define SETTINGS_ENABLE_PUSH 0x2
+#define SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define SETTINGS_MAX_FRAME_SIZE 0x5
+#define SETTINGS_MAX_HEADER_LIST_SIZE 0x6
+
+#define FRAME_HEAD 9
+#define PREFACE_LEN (sizeof(H2_PREFACE) - 1)
+#define IN_CAP (FRAME_HEAD + H2_FRAME_SIZE)  // we never allow frames larger than the default.
+#define OUT_FLUSH (4 * H2_FRAME_SIZE)
+
+static _Thread_local h2Session* sessions = NULL;
+
+static uint32_t read24(const unsigned char* p) {
+    return (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+}
+
+static uint32_t read32(const unsigned char* p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static void write32(unsigned char* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// appends a frame head to the output and returns where its "len" payload bytes go.
+static unsigned char* frame(h2Session* s, size_t len, int type, int flags, uint32_t stream) {
+    if (s->outLen + FRAME_HEAD + len > s->outCap) {
+        size_t cap = s->outCap * 2;
+        while (cap < s->outLen + FRAME_HEAD + len)
+            cap *= 2;
+        unsigned char* grown = realloc(s->out, cap);
+        if (grown == NULL)
+            return NULL;
+        s->out = grown;
+        s->outCap = cap;
+    }
+    unsigned char* p = s->out + s->outLen;
+    p[0] = len >> 16;
+    p[1] = len >> 8;
+    p[2] = len;
+    p[3] = type;
+    p[4] = flags;
+    write32(p + 5, stream & 0x7fffffff);
+    s->outLen += FRAME_HEAD + len;
+    return p + FRAME_HEAD;
+}
+
+// writes what the socket takes, the rest stays in "out" until it is writable again (see "h2Write").
+static int flush(h2Session* s) {
+    size_t off = 0;
+    while (off < s->outLen) {
+        const ssize_t n = write(s->fd, s->out + off, s->outLen - off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            s->outLen = 0;
+            return -1;
+        }
+        off += n;
+    }
+    statsLocal()->bytesOut += off;
+    memmove(s->out, s->out + off, s->outLen - off);
+    s->outLen -= off;
+    return 0;
+}
+
+static void windowUpdate(h2Session* s, uint32_t stream, uint32_t increment) {
+    unsigned char* p = frame(s, 4, FRAME_WINDOW_UPDATE, 0, stream);
+    if (p != NULL)
+        write32(p, increment);
+}
+
+static h2Stream* findStream(const h2Session* s, uint32_t id) {
+    for (int i = 0; i < s->streamCount; i++)
+        if (s->streams[i]->id == id)
+            return s->streams[i];
+    return NULL;
+}
+
+static h2Stream* openStream(h2Session* s, uint32_t id) {
+    h2Stream* st;
+    if (s->streamCount == s->maxStreams || (st = calloc(1, sizeof(h2Stream))) == NULL)
+        return NULL;
+    st->id = id;
+    st->sendWindow = s->initialWindow;
+    s->streams[s->streamCount++] = st;
+    return st;
+}
+
+static void closeStream(h2Session* s, h2Stream* st) {
+    for (int i = 0; i < s->streamCount; i++) {
+        if (s->streams[i] == st) {
+            s->streams[i] = s->streams[--s->streamCount];
+            break;
+        }
+    }
+    if (st->file != NULL)
+        staticRelease(st->file);
+    free(st->method);
+    free(st->path);
+    free(st->body);
+    free(st);
+}
+
+static int streamError(h2Session* s, uint32_t id, uint32_t code) {
+    unsigned char* p = frame(s, 4, FRAME_RST_STREAM, 0, id);
+    if (p != NULL)
+        write32(p, code);
+    h2Stream* st = findStream(s, id);
+    if (st != NULL)
+        closeStream(s, st);
+    statsLocal()->errors++;
+    return 0;
+}
+
+// tells the peer why and how far requests were processed, the caller closes the connection.
+static int connError(h2Session* s, uint32_t code) {
+    unsigned char* p = frame(s, 8, FRAME_GOAWAY, 0, 0);
+    if (p != NULL) {
+        write32(p, s->lastStreamId);
+        write32(p + 4, code);
+    }
+    s->goingAway = 1;
+    statsLocal()->errors++;
+    flush(s);
+    return -1;
+}
+
+// sends DATA round-robin, one frame per stream and pass, while the windows allow and the
+// socket keeps up; the bodies left wait on their streams until "h2Write".
+static void pump(h2Session* s) {
+    for (int sent = 1; sent && s->sendWindow > 0 && s->outLen < OUT_FLUSH;) {
+        sent = 0;
+        for (int i = 0; i < s->streamCount && s->sendWindow > 0 && s->outLen < OUT_FLUSH; i++) {
+            h2Stream* st = s->streams[i];
+            if (!st->responded || st->sendWindow <= 0)
+                continue;
+            const size_t left = st->file != NULL ? (size_t) (st->file->size - st->fileOff) : st->bodyLen - st->bodyOff;
+            size_t n = left < (size_t) st->sendWindow ? left : (size_t) st->sendWindow;
+            n = n < (size_t) s->sendWindow ? n : (size_t) s->sendWindow;
+            n = n < s->maxFrameSize ? n : s->maxFrameSize;
+            unsigned char* payload = frame(s, n, FRAME_DATA, n == left ? FLAG_END_STREAM : 0, st->id);
+            if (payload == NULL)
+                return;
+            if (st->file == NULL) {
+                memcpy(payload, st->body + st->bodyOff, n);
+                st->bodyOff += n;
+            } else if (pread(st->file->fd, payload, n, st->fileOff) == (ssize_t) n) {
+                st->fileOff += n;
+            } else {
+                s->outLen -= FRAME_HEAD + n;  // the file shrank under us.
+                streamError(s, st->id, ERR_INTERNAL);
+                i--;
+                continue;
+            }
+            st->sendWindow -= n;
+            s->sendWindow -= n;
+            sent = 1;
+            if (n == left) {
+                closeStream(s, st);
+                i--;
+            }
+            if (s->outLen >= OUT_FLUSH)
+                flush(s);  // bounds the buffer however large the peer's windows are.
+        }
+    }
+}
+
+// HEADERS are not flow controlled, a response head goes out at once.
+static void sendHeaders(h2Session* s, h2Stream* st, const unsigned char* block, size_t len, int endStream) {
+    unsigned char* p = frame(s, len, FRAME_HEADERS, FLAG_END_HEADERS | (endStream ? FLAG_END_STREAM : 0), st->id);
+    if (p != NULL)
+        memcpy(p, block, len);
+    st->responded = 1;
+}
+
+void h2Respond(h2Session* s, uint32_t id, int status, const char* contentType, const char* body, size_t len) {
+    h2RespondHeader(s, id, status, contentType, NULL, NULL, body, len);
+}
+
+// the same with one more header "name: value", the name in lowercase as HTTP/2 requires.
+void h2RespondHeader(h2Session* s, uint32_t id, int status, const char* contentType, const char* name,
+                     const char* value, const char* body, size_t len) {
+    h2Stream* st = findStream(s, id);
+    if (st == NULL || st->responded)
+        return;
+    unsigned char block[256];
+    size_t n = hpackEncodeStatus(block, status);
+    if (contentType != NULL)
+        n += hpackEncodeField(block + n, HPACK_CONTENT_TYPE, contentType, strlen(contentType));
+    if (name != NULL)
+        n += hpackEncodeNamed(block + n, name, strlen(name), value, strlen(value));
+    char digits[24];
+    n += hpackEncodeField(block + n, HPACK_CONTENT_LENGTH, digits, snprintf(digits, sizeof(digits), "%zu", len));
+    if (len > 0 && (st->body = malloc(len)) == NULL) {
+        streamError(s, id, ERR_INTERNAL);
+        return;
+    }
+    sendHeaders(s, st, block, n, len == 0);
+    if (len == 0) {
+        closeStream(s, st);
+        return;
+    }
+    memcpy(st->body, body, len);
+    st->bodyLen = len;
+    pump(s);
+}
+
+// takes over the caller's reference to "sf", the body is read from it as window opens up.
+void h2RespondFile(h2Session* s, uint32_t id, staticFile* sf, int headOnly) {
+    h2Stream* st = findStream(s, id);
+    if (st == NULL || st->responded) {
+        staticRelease(sf);
+        return;
+    }
+    unsigned char block[256];
+    size_t n = hpackEncodeStatus(block, 200);
+    n += hpackEncodeField(block + n, HPACK_CONTENT_TYPE, sf->contentType, strlen(sf->contentType));
+    char digits[24];
+    n += hpackEncodeField(block + n, HPACK_CONTENT_LENGTH, digits,
+                          snprintf(digits, sizeof(digits), "%lld", (long long) sf->size));
+    n += hpackEncodeField(block + n, HPACK_LAST_MODIFIED, sf->modified, strlen(sf->modified));
+    const int empty = headOnly || sf->size == 0;
+    sendHeaders(s, st, block, n, empty);
+    if (empty) {
+        staticRelease(sf);
+        closeStream(s, st);
+        return;
+    }
+    st->file = sf;
+    pump(s);
+}
+
+// the request on "st" is complete: answered by the server's handler, or refused here.
+static int requestDone(h2Session* s, h2Stream* st) {
+    st->requestDone = 1;
+    const uint32_t id = st->id;
+    if (st->headerBytes > s->maxHeaderBytes) {
+        h2Respond(s, id, 431, NULL, NULL, 0);
+        return 0;
+    }
+    const strSpan method = { st->method, strlen(st->method) }, path = { st->path, strlen(st->path) };
+    s->onRequest(s, id, &method, &path);
+    if ((st = findStream(s, id)) != NULL && !st->responded)
+        h2Respond(s, id, 500, NULL, NULL, 0);
+    return 0;
+}
+
+typedef struct {
+    h2Stream* st;  // NULL when the block is only decoded to keep the table in sync.
+    int regularSeen;
+    int malformed;
+    size_t bytes;
+} headerContext;
+
+static char* copySpan(const char* p, size_t len) {
+    char* copy = malloc(len + 1);
+    if (copy != NULL) {
+        memcpy(copy, p, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+// keeps ":method" and ":path", the rest of the request head is of no use to the handlers.
+static void onField(void* arg, const char* name, size_t nameLen, const char* value, size_t valueLen) {
+    headerContext* hc = arg;
+    hc->bytes += 32 + nameLen + valueLen;  // how SETTINGS_MAX_HEADER_LIST_SIZE counts.
+    if (hc->st == NULL)
+        return;
+    if (nameLen == 0 || name[0] != ':') {
+        hc->regularSeen = 1;
+        return;
+    }
+    char** slot = nameLen == 7 && memcmp(name, ":method", 7) == 0 ? &hc->st->method
+                : nameLen == 5 && memcmp(name, ":path", 5) == 0 ? &hc->st->path : NULL;
+    if (hc->regularSeen)
+        hc->malformed = 1;  // pseudo-headers come first.
+    else if (slot != NULL)
+        hc->malformed |= *slot != NULL || (*slot = copySpan(value, valueLen)) == NULL;
+    else if (!(nameLen == 7 && memcmp(name, ":scheme", 7) == 0) && !(nameLen == 10 && memcmp(name, ":authority", 10) == 0))
+        hc->malformed = 1;
+}
+
+static int endHeaders(h2Session* s) {
+    const uint32_t id = s->blockStream;
+    h2Stream* st = findStream(s, id);
+    const int trailers = st != NULL;
+    headerContext hc = { NULL, 0, 0, 0 };
+    if (!trailers) {
+        s->lastStreamId = id;
+        hc.st = s->goingAway ? NULL : openStream(s, id);
+    }
+    s->blockStream = 0;
+    if (hpackDecode(&s->decoder, s->block, s->blockLen, onField, &hc) < 0)
+        return connError(s, ERR_COMPRESSION);
+    if (trailers)
+        return s->blockEndStream ? requestDone(s, st) : streamError(s, id, ERR_PROTOCOL);
+    if ((st = hc.st) == NULL)
+        return streamError(s, id, ERR_REFUSED_STREAM);  // over the concurrency limit, or draining.
+    if (hc.malformed || st->method == NULL || st->path == NULL)
+        return streamError(s, id, ERR_PROTOCOL);
+    st->headerBytes = hc.bytes;
+    return s->blockEndStream ? requestDone(s, st) : 0;
+}
+
+static int appendBlock(h2Session* s, const unsigned char* p, size_t len, int flags) {
+    if (s->blockLen + len > 2 * s->maxHeaderBytes)
+        return connError(s, ERR_ENHANCE_YOUR_CALM);  // bigger than any head we would accept.
+    if (s->blockLen + len > s->blockCap) {
+        const size_t cap = s->blockLen + len > 2 * s->blockCap ? s->blockLen + len : 2 * s->blockCap;
+        unsigned char* grown = realloc(s->block, cap);
+        if (grown == NULL)
+            return connError(s, ERR_INTERNAL);
+        s->block = grown;
+        s->blockCap = cap;
+    }
+    memcpy(s->block + s->blockLen, p, len);
+    s->blockLen += len;
+    return flags & FLAG_END_HEADERS ? endHeaders(s) : 0;
+}
+
+// returns 0 or the error code the settings violate.
+static uint32_t applySettings(h2Session* s, const unsigned char* p, size_t len) {
+    for (; len >= 6; p += 6, len -= 6) {
+        const uint32_t value = read32(p + 2);
+        switch (p[0] << 8 | p[1]) {
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1)
+                    return ERR_PROTOCOL;
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > H2_MAX_WINDOW)
+                    return ERR_FLOW_CONTROL;
+                // the change applies to the windows of streams already open too.
+                const long delta = (long) value - s->initialWindow;
+                for (int i = 0; i < s->streamCount; i++) {
+                    if (s->streams[i]->sendWindow + delta > H2_MAX_WINDOW)
+                        return ERR_FLOW_CONTROL;
+                    s->streams[i]->sendWindow += delta;
+                }
+                s->initialWindow = value;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < H2_FRAME_SIZE || value > 0xffffff)
+                    return ERR_PROTOCOL;
+                s->maxFrameSize = value;
+                break;
+            default:
+                break;  // nothing we send depends on the others, we never index or push.
+        }
+    }
+    return ERR_NONE;
+}
+
+// strips the padding of DATA and HEADERS, -1 if it does not fit in the payload.
+static int unpad(int flags, const unsigned char** p, size_t* len) {
+    if (!(flags & FLAG_PADDED))
+        return 0;
+    if (*len == 0 || **p >= *len)
+        return -1;
+    *len -= 1 + **p;
+    (*p)++;
+    return 0;
+}
+
+static int onFrame(h2Session* s, int type, int flags, uint32_t id, const unsigned char* p, size_t len) {
+    // a header block is never interleaved with other frames.
+    if (s->blockStream != 0 && (type != FRAME_CONTINUATION || id != s->blockStream))
+        return connError(s, ERR_PROTOCOL);
+    if (!s->settingsSeen && type != FRAME_SETTINGS)
+        return connError(s, ERR_PROTOCOL);
+    h2Stream* st;
+    switch (type) {
+        case FRAME_DATA: {
+            const size_t frameLen = len;
+            if (id == 0 || unpad(flags, &p, &len) < 0)
+                return connError(s, ERR_PROTOCOL);
+            // request bodies are not used, so their window goes straight back.
+            if ((s->recvUnacked += frameLen) >= H2_DEFAULT_WINDOW / 2) {
+                windowUpdate(s, 0, s->recvUnacked);
+                s->recvUnacked = 0;
+            }
+            if ((st = findStream(s, id)) == NULL || st->requestDone)
+                return id > s->lastStreamId ? connError(s, ERR_PROTOCOL) : streamError(s, id, ERR_STREAM_CLOSED);
+            if (flags & FLAG_END_STREAM)
+                return requestDone(s, st);
+            if (frameLen > 0)
+                windowUpdate(s, id, frameLen);
+            return 0;
+        }
+        case FRAME_HEADERS:
+            if (id == 0 || !(id & 1) || unpad(flags, &p, &len) < 0)
+                return connError(s, ERR_PROTOCOL);
+            if (flags & FLAG_PRIORITY) {
+                if (len < 5)
+                    return connError(s, ERR_FRAME_SIZE);
+                p += 5;
+                len -= 5;
+            }
+            if ((st = findStream(s, id)) != NULL ? st->requestDone : id <= s->lastStreamId)
+                return connError(s, st != NULL ? ERR_STREAM_CLOSED : ERR_PROTOCOL);
+            s->blockStream = id;
+            s->blockEndStream = flags & FLAG_END_STREAM;
+            s->blockLen = 0;
+            return appendBlock(s, p, len, flags);
+        case FRAME_CONTINUATION:
+            return s->blockStream == 0 ? connError(s, ERR_PROTOCOL) : appendBlock(s, p, len, flags);
+        case FRAME_PRIORITY:
+            if (id == 0)
+                return connError(s, ERR_PROTOCOL);
+            return len == 5 ? 0 : streamError(s, id, ERR_FRAME_SIZE);  // priorities are not acted on.
+        case FRAME_RST_STREAM:
+            if (id == 0 || id > s->lastStreamId)
+                return connError(s, ERR_PROTOCOL);
+            if (len != 4)
+                return connError(s, ERR_FRAME_SIZE);
+            if ((st = findStream(s, id)) != NULL)
+                closeStream(s, st);
+            return 0;
+        case FRAME_SETTINGS: {
+            if (id != 0)
+                return connError(s, ERR_PROTOCOL);
+            if (flags & FLAG_ACK)
+                return len == 0 ? 0 : connError(s, ERR_FRAME_SIZE);
+            if (len % 6 != 0)
+                return connError(s, ERR_FRAME_SIZE);
+            const uint32_t code = applySettings(s, p, len);
+            if (code != ERR_NONE)
+                return connError(s, code);
+            s->settingsSeen = 1;
+            frame(s, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+            pump(s);  // a larger initial window may let waiting bodies go.
+            return 0;
+        }
+        case FRAME_PING: {
+            if (id != 0)
+                return connError(s, ERR_PROTOCOL);
+            if (len != 8)
+                return connError(s, ERR_FRAME_SIZE);
+            unsigned char* pong = flags & FLAG_ACK ? NULL : frame(s, 8, FRAME_PING, FLAG_ACK, 0);
+            if (pong != NULL)
+                memcpy(pong, p, 8);
+            return 0;
+        }
+        case FRAME_GOAWAY:
+            if (id != 0)
+                return connError(s, ERR_PROTOCOL);
+            s->goingAway = 1;  // finish what is open, then close.
+            return 0;
+        case FRAME_WINDOW_UPDATE: {
+            if (len != 4)
+                return connError(s, ERR_FRAME_SIZE);
+            const uint32_t increment = read32(p) & 0x7fffffff;
+            if (id == 0) {
+                if (increment == 0)
+                    return connError(s, ERR_PROTOCOL);
+                if ((long) s->sendWindow + increment > H2_MAX_WINDOW)
+                    return connError(s, ERR_FLOW_CONTROL);
+                s->sendWindow += increment;
+            } else {
+                if (id > s->lastStreamId)
+                    return connError(s, ERR_PROTOCOL);
+                if (increment == 0)
+                    return streamError(s, id, ERR_PROTOCOL);
+                if ((st = findStream(s, id)) == NULL)
+                    return 0;  // the stream finished meanwhile.
+                if ((long) st->sendWindow + increment > H2_MAX_WINDOW)
+                    return streamError(s, id, ERR_FLOW_CONTROL);
+                st->sendWindow += increment;
+            }
+            pump(s);
+            return 0;
+        }
+        case FRAME_PUSH_PROMISE:
+            return connError(s, ERR_PROTOCOL);  // clients never push.
+        default:
+            return 0;  // unknown frame types are ignored.
+    }
+}
+
+// handles every complete frame in the input, -1 once the connection has to close.
+static int process(h2Session* s) {
+    size_t off = 0;
+    if (!s->prefaceDone) {
+        const size_t n = s->inLen < PREFACE_LEN ? s->inLen : PREFACE_LEN;
+        if (memcmp(s->in, H2_PREFACE, n) != 0)
+            return connError(s, ERR_PROTOCOL);
+        if (n < PREFACE_LEN)
+            return 0;
+        s->prefaceDone = 1;
+        off = PREFACE_LEN;
+        // an upgraded request is answered only now, so nothing but SETTINGS follows the 101
+        // before the client has switched (some clients cannot buffer more).
+        h2Stream* upgraded = findStream(s, 1);
+        if (upgraded != NULL && !upgraded->requestDone)
+            requestDone(s, upgraded);
+    }
+    int result = 0;
+    while (result == 0 && s->inLen - off >= FRAME_HEAD) {
+        const unsigned char* head = s->in + off;
+        const size_t len = read24(head);
+        if (len > H2_FRAME_SIZE) {
+            result = connError(s, ERR_FRAME_SIZE);
+            break;
+        }
+        if (s->inLen - off < FRAME_HEAD + len)
+            break;  // wait for the rest of the frame.
+        result = onFrame(s, head[3], head[4], read32(head + 5) & 0x7fffffff, head + FRAME_HEAD, len);
+        off += FRAME_HEAD + len;
+    }
+    memmove(s->in, s->in + off, s->inLen - off);
+    s->inLen -= off;
+    return result;
+}
+
+h2Session* h2Open(int fd, const serverSettings* ss, h2RequestFn onRequest) {
+    h2Session* s = calloc(1, sizeof(h2Session));
+    if (s == NULL)
+        return NULL;
+    s->in = malloc(IN_CAP);
+    s->out = malloc(s->outCap = OUT_FLUSH);
+    if (s->in == NULL || s->out == NULL) {
+        free(s->in);
+        free(s->out);
+        free(s);
+        return NULL;
+    }
+    s->fd = fd;
+    s->onRequest = onRequest;
+    s->maxStreams = ss->h2MaxStreams;
+    s->maxHeaderBytes = ss->maxHeaderBytes;
+    s->sendWindow = s->initialWindow = H2_DEFAULT_WINDOW;
+    s->maxFrameSize = H2_FRAME_SIZE;
+    hpackDecoderInit(&s->decoder);
+    // our SETTINGS open the connection, the client's may already be on the way.
+    unsigned char* p = frame(s, 12, FRAME_SETTINGS, 0, 0);
+    const uint32_t settings[2][2] = {
+        { SETTINGS_MAX_CONCURRENT_STREAMS, s->maxStreams },
+        { SETTINGS_MAX_HEADER_LIST_SIZE, s->maxHeaderBytes },
+    };
+    for (int i = 0; i < 2; i++, p += 6) {
+        p[0] = settings[i][0] >> 8;
+        p[1] = settings[i][0];
+        write32(p + 2, settings[i][1]);
+    }
+    if ((s->next = sessions) != NULL)
+        sessions->prev = s;
+    sessions = s;
+    return s;
+}
+
+// applies "HTTP2-Settings" (base64url SETTINGS payload) of an upgrade request, -1 if invalid.
+int h2Upgrade(h2Session* s, const char* value, size_t len) {
+    unsigned char payload[len * 3 / 4 + 3];
+    size_t n = 0;
+    unsigned bits = 0, acc = 0;
+    for (size_t i = 0; i < len && value[i] != '='; i++) {
+        const char c = value[i];
+        const int v = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26
+                    : c >= '0' && c <= '9' ? c - '0' + 52 : c == '-' || c == '+' ? 62 : c == '_' || c == '/' ? 63 : -1;
+        if (v < 0)
+            return -1;
+        acc = acc << 6 | v;
+        if ((bits += 6) >= 8)
+            payload[n++] = acc >> (bits -= 8);
+    }
+    return n % 6 == 0 && applySettings(s, payload, n) == ERR_NONE ? 0 : -1;
+}
+
+// takes the request that carried the upgrade as stream 1, answered once the preface arrives.
+int h2UpgradeRequest(h2Session* s, const strSpan* method, const strSpan* target) {
+    h2Stream* st = openStream(s, 1);
+    s->lastStreamId = 1;
+    if (st == NULL || (st->method = copySpan(method->ptr, method->len)) == NULL
+        || (st->path = copySpan(target->ptr, target->len)) == NULL)
+        return -1;
+    return flush(s);
+}
+
+// bytes that arrived before the switch to HTTP/2.
+int h2Input(h2Session* s, const char* data, size_t len) {
+    while (len > 0) {
+        const size_t n = len < IN_CAP - s->inLen ? len : IN_CAP - s->inLen;
+        memcpy(s->in + s->inLen, data, n);
+        s->inLen += n;
+        data += n;
+        len -= n;
+        if (process(s) < 0)
+            return -1;
+    }
+    return flush(s);
+}
+
+// reads and answers what the socket has, -1 once the connection should be closed.
+int h2Read(h2Session* s) {
+    while (1) {
+        const ssize_t n = read(s->fd, s->in + s->inLen, IN_CAP - s->inLen);
+        if (n > 0) {
+            statsLocal()->bytesIn += n;
+            s->inLen += n;
+            if (process(s) < 0)
+                return -1;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        flush(s);
+        return -1;
+    }
+    // after a GOAWAY either way, the connection closes once nothing is left to send.
+    return flush(s) < 0 || (s->goingAway && s->streamCount == 0 && s->outLen == 0) ? -1 : 0;
+}
+
+// whether output waits for the socket to become writable.
+int h2Pending(const h2Session* s) {
+    return s->outLen > 0;
+}
+
+// the socket became writable: sends what waited and the bodies the windows allow, -1 once the
+// connection should be closed.
+int h2Write(h2Session* s) {
+    if (flush(s) < 0)
+        return -1;
+    if (s->outLen == 0) {
+        pump(s);
+        if (flush(s) < 0)
+            return -1;
+    }
+    return s->goingAway && s->streamCount == 0 && s->outLen == 0 ? -1 : 0;
+}
+
+// sent when the worker drains: no new streams, idle connections are shut right away.
+void h2GoAwayAll(void) {
+    for (h2Session* s = sessions; s != NULL; s = s->next) {
+        if (s->goingAway)
+            continue;
+        unsigned char* p = frame(s, 8, FRAME_GOAWAY, 0, 0);
+        if (p != NULL) {
+            write32(p, s->lastStreamId);
+            write32(p + 4, ERR_NONE);
+        }
+        s->goingAway = 1;
+        if (flush(s) < 0 || (s->streamCount == 0 && s->outLen == 0))
+            shutdown(s->fd, SHUT_RDWR);  // its event loop sees the hang-up and closes it.
+    }
+}
+
+void h2Close(h2Session* s) {
+    if (s->prev != NULL)
+        s->prev->next = s->next;
+    else
+        sessions = s->next;
+    if (s->next != NULL)
+        s->next->prev = s->prev;
+    while (s->streamCount > 0)
+        closeStream(s, s->streams[0]);
+    hpackDecoderRelease(&s->decoder);
+    free(s->block);
+    free(s->in);
+    free(s->out);
+    free(s);
+}
@@ -0,0 +1,28 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_H2_H
+#define THINKING_IN_C_H2_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "structs.h"
+
+// what a client opens an HTTP/2 connection with ("prior knowledge").
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+h2Session* h2Open(int, const serverSettings*, h2RequestFn);
+int h2Upgrade(h2Session*, const char*, size_t);
+int h2UpgradeRequest(h2Session*, const strSpan*, const strSpan*);
+int h2Input(h2Session*, const char*, size_t);
+int h2Read(h2Session*);
+int h2Pending(const h2Session*);
+int h2Write(h2Session*);
+void h2Respond(h2Session*, uint32_t, int, const char*, const char*, size_t);
+void h2RespondHeader(h2Session*, uint32_t, int, const char*, const char*, const char*, const char*, size_t);
+void h2RespondFile(h2Session*, uint32_t, staticFile*, int);
+void h2GoAwayAll(void);
+void h2Close(h2Session*);
+
+#endif //THINKING_IN_C_H2_H
@@ -0,0 +1,99 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string.h>
+#include <unistd.h>
+#include "handoff.h"
+#include "macros.h"
+
+static int controlAddr(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+        return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// asks a running server for its descriptors, returns how many arrived or -1 when nobody answers.
+int handoffReceive(const char* path, int* fds, int maxFds) {
+    struct sockaddr_un addr;
+    int sock;
+    if (controlAddr(path, &addr) < 0 || (sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    char tag;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { &tag, 1 };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+    const ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    close(sock);
+    if (n != 1 || tag != 'H')
+        return -1;
+
+    int count = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        const int received = (int) ((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < received; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (count < maxFds)
+                fds[count++] = fd;
+            else
+                close(fd);
+        }
+    }
+    return count;
+}
+
+// takes over the control path, the previous owner (if any) has already handed off.
+int handoffListen(const char* path) {
+    struct sockaddr_un addr;
+    int sock;
+    if (controlAddr(path, &addr) < 0 || (sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    unlink(path);
+    if (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(sock, 1) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// blocks until a successor connects and sends it the descriptors, returns 0 once they are delivered.
+int handoffServe(int controlFd, const int* fds, int count) {
+    const int sock = accept4(controlFd, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0)
+        return -1;
+
+    char tag = 'H';
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { &tag, 1 };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf,
+                          .msg_controllen = CMSG_SPACE(sizeof(int) * count) };
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    const ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    close(sock);
+    return n == 1 ? 0 : -1;
+}
@@ -0,0 +1,12 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_HANDOFF_H
+#define THINKING_IN_C_HANDOFF_H
+
+int handoffReceive(const char*, int*, int);
+int handoffListen(const char*);
+int handoffServe(int, const int*, int);
+
+#endif //THINKING_IN_C_HANDOFF_H
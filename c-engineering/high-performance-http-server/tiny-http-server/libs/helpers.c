@@ -1,11 +1,14 @@
 //
 // Created by fufeng on 2024/2/2.
 //
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <tgmath.h>
 #include <uriparser/Uri.h>
+#include "affinity.h"
 #include "helpers.h"
+#include "http.h"
 #include "structs.h"
 
 int __calcFibTCO(int n, int x, int y) {
@@ -37,15 +40,20 @@ void wrapStrFromPTR(char* str, size_t len, const char* head, const char* tail) {
     str[len - 1] = '\0';
 }
 
-int retrieveGETQueryIntValByKey(char* req, const char* key) {
-    int result = 0;
-
+int retrieveGETQueryIntValByKey(const char* req, size_t reqLen, const char* key) {
     // extract uri;
-    const char* uriHead = strchr(req, ' ') + 1;
-    const char* uriTail = strchr(uriHead, ' ');
-    size_t uriLen = uriTail - uriHead + 1;
+    httpRequestLine rl;
+    if (httpParseRequestLine(req, reqLen, &rl) < 0)
+        return 0;
+    return retrieveQueryIntValByKey(rl.target.ptr, rl.target.len, key);
+}
+
+// copies the value of "key" in the query of "target" into "val", -1 if it has none.
+static int retrieveQueryValByKey(const char* target, size_t targetLen, const char* key, char* val, size_t cap) {
+    int result = -1;
+    size_t uriLen = targetLen + 1;
     char strUri[uriLen];
-    wrapStrFromPTR(strUri, uriLen, uriHead, uriTail);
+    wrapStrFromPTR(strUri, uriLen, target, target + targetLen);
 
     // parse uri;
     UriUriA uri;
@@ -54,19 +62,39 @@ int retrieveGETQueryIntValByKey(char* req, const char* key) {
     const char* errorPos;
     if (uriParseSingleUriA(&uri, strUri, &errorPos) == URI_SUCCESS) {
         if (uriDissectQueryMallocA(&queryList, &itemCount, uri.query.first, uri.query.afterLast) == URI_SUCCESS) {
-            while (itemCount--) {
-                if (strcmp(queryList->key, key) == 0) {
-                    result = atoi(queryList->value);
+            for (UriQueryListA* item = queryList; itemCount-- > 0; item = item->next) {
+                if (strcmp(item->key, key) == 0 && item->value != NULL && strlen(item->value) < cap) {
+                    strcpy(val, item->value);
+                    result = 0;
                     break;
                 }
-                queryList = queryList->next;
             }
             uriFreeQueryListA(queryList);
         }
+        uriFreeUriMembersA(&uri);
     }
     return result;
 }
 
+// the same for a bare request target, as HTTP/2 carries it in ":path".
+int retrieveQueryIntValByKey(const char* target, size_t targetLen, const char* key) {
+    char val[32];
+    return retrieveQueryValByKey(target, targetLen, key, val, sizeof(val)) == 0 ? atoi(val) : 0;
+}
+
+// an unsigned 64-bit value, -1 if "key" is missing or not a plain decimal number.
+int retrieveQueryU64ValByKey(const char* target, size_t targetLen, const char* key, uint64_t* result) {
+    char val[32], * end;
+    if (retrieveQueryValByKey(target, targetLen, key, val, sizeof(val)) < 0 || val[0] < '0' || val[0] > '9')
+        return -1;
+    errno = 0;
+    const unsigned long long parsed = strtoull(val, &end, 10);
+    if (errno != 0 || *end != '\0')
+        return -1;
+    *result = parsed;
+    return 0;
+}
+
 void setupServerSettings(int argc, const char** argv, serverSettings* ss) {
     while (argc-- > 1) {
         // process key.
@@ -84,6 +112,79 @@ void setupServerSettings(int argc, const char** argv, serverSettings* ss) {
             val[i++] = *valHead;
         if (strcmp(key, "thread_count") == 0) {
             ss->threadCount = atoi(val);
+        } else if (strcmp(key, "hugepages") == 0) {
+            ss->hugePages = atoi(val);
+        } else if (strcmp(key, "max_header_bytes") == 0) {
+            ss->maxHeaderBytes = strtoul(val, NULL, 10);
+        } else if (strcmp(key, "simd") == 0) {
+            ss->simd = keyHead + keyLen;  // argv outlives the settings.
+        } else if (strcmp(key, "mode") == 0) {
+            ss->prefork = strcmp(val, "prefork") == 0;
+        } else if (strcmp(key, "workers") == 0) {
+            ss->workerCount = atoi(val);
+        } else if (strcmp(key, "memo") == 0) {
+            ss->memo = keyHead + keyLen;
+        } else if (strcmp(key, "store") == 0) {
+            ss->store = keyHead + keyLen;
+        } else if (strcmp(key, "store_min_us") == 0) {
+            ss->storeMinMicros = atol(val);
+        } else if (strcmp(key, "handoff") == 0) {
+            ss->handoff = keyHead + keyLen;
+        } else if (strcmp(key, "min_threads") == 0) {
+            ss->minThreads = atoi(val);
+        } else if (strcmp(key, "max_threads") == 0) {
+            ss->maxThreads = atoi(val);
+        } else if (strcmp(key, "scale_interval_ms") == 0) {
+            ss->scaleIntervalMs = atoi(val);
+        } else if (strcmp(key, "cpus") == 0) {
+            ss->cpuCount = affinityParse(val, ss->cpus, MAX_PINNED_CPUS);
+        } else if (strcmp(key, "main_cpu") == 0) {
+            ss->mainCpu = atoi(val);
+        } else if (strcmp(key, "numa") == 0) {
+            ss->numa = atoi(val);
+        } else if (strcmp(key, "listener_shards") == 0) {
+            ss->listenerShards = atoi(val);
+        } else if (strcmp(key, "busy_poll_us") == 0) {
+            ss->busyPollMicros = atoi(val);
+        } else if (strcmp(key, "spin_us") == 0) {
+            ss->spinMicros = atol(val);
+        } else if (strcmp(key, "backlog") == 0) {
+            ss->backlog = atoi(val);
+        } else if (strcmp(key, "defer_accept") == 0) {
+            ss->deferAcceptSeconds = atoi(val);
+        } else if (strcmp(key, "fastopen") == 0) {
+            ss->fastOpenQueue = atoi(val);
+        } else if (strcmp(key, "accept_batch") == 0) {
+            ss->acceptBatch = atoi(val);
+        } else if (strcmp(key, "epoll_exclusive") == 0) {
+            ss->epollExclusive = atoi(val);
+        } else if (strcmp(key, "plugin") == 0) {
+            ss->plugin = keyHead + keyLen;
+        } else if (strcmp(key, "static_root") == 0) {
+            ss->staticRoot = keyHead + keyLen;
+        } else if (strcmp(key, "h2") == 0) {
+            ss->h2 = atoi(val);
+        } else if (strcmp(key, "h2_max_streams") == 0) {
+            ss->h2MaxStreams = atoi(val);
+        } else if (strcmp(key, "max_num") == 0) {
+            ss->maxNum = atol(val);
+        } else if (strcmp(key, "compute_threads") == 0) {
+            ss->computeThreads = atoi(val);
+        } else if (strcmp(key, "degrade_queue_us") == 0) {
+            ss->degradeQueueMicros = atol(val);
+        } else if (strcmp(key, "degrade_tolerance") == 0) {
+            ss->degradeTolerance = strtod(val, NULL);
+        } else if (strcmp(key, "batch") == 0) {
+            ss->batch = atoi(val);
+        } else if (strcmp(key, "keepalive_requests") == 0) {
+            ss->keepAliveRequests = atoi(val);
+        } else if (strcmp(key, "write_timeout_ms") == 0) {
+            ss->writeTimeoutMs = atoi(val);
+        } else if (strcmp(key, "capture") == 0) {
+            ss->capture = keyHead + keyLen;
+        } else if (strcmp(key, "listen") == 0) {
+            // "unix:/path" serves on a Unix domain socket, anything else keeps TCP.
+            ss->unixPath = strncmp(val, "unix:", 5) == 0 ? keyHead + keyLen + 5 : NULL;
         }
     }
 }
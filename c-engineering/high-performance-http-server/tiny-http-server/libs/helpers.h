@@ -5,13 +5,16 @@
 #ifndef THINKING_IN_C_HELPERS_H
 #define THINKING_IN_C_HELPERS_H
 
+#include <stdint.h>
 #include "structs.h"
 
 int calcFibonacci(int);
 int __calcFibTCO(int, int, int);
 int __calcFibRecursion(int);
 int calcDigits(int);
-int retrieveGETQueryIntValByKey(char*, const char*);
+int retrieveGETQueryIntValByKey(const char*, size_t, const char*);
+int retrieveQueryIntValByKey(const char*, size_t, const char*);
+int retrieveQueryU64ValByKey(const char*, size_t, const char*, uint64_t*);
 void wrapStrFromPTR(char*, size_t, const char*, const char*);
 void setupServerSettings(int, const char**, serverSettings*);
 
@@ -0,0 +1,333 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// HPACK (RFC 7541). the decoder keeps the dynamic table the peer builds; fields found in the
+// static table are handed out in place without touching it. the encoder never indexes, every
+// response field is either a static table entry or a literal with a static name, so it keeps
+// no state and the peer's table stays empty.
+//
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hpack.h"
+
+#define FIELD(name, value) { name, value, sizeof(name) - 1, sizeof(value) - 1 }
+
+// lengths are kept with the strings, so a static hit costs no strlen.
+static const struct {
+    const char* name;
+    const char* value;
+    size_t nameLen;
+    size_t valueLen;
+} staticTable[] = {
+    FIELD("", ""),  // indices start at 1.
+    FIELD(":authority", ""), FIELD(":method", "GET"), FIELD(":method", "POST"),
+    FIELD(":path", "/"), FIELD(":path", "/index.html"), FIELD(":scheme", "http"),
+    FIELD(":scheme", "https"), FIELD(":status", "200"), FIELD(":status", "204"),
+    FIELD(":status", "206"), FIELD(":status", "304"), FIELD(":status", "400"),
+    FIELD(":status", "404"), FIELD(":status", "500"), FIELD("accept-charset", ""),
+    FIELD("accept-encoding", "gzip, deflate"), FIELD("accept-language", ""), FIELD("accept-ranges", ""),
+    FIELD("accept", ""), FIELD("access-control-allow-origin", ""), FIELD("age", ""),
+    FIELD("allow", ""), FIELD("authorization", ""), FIELD("cache-control", ""),
+    FIELD("content-disposition", ""), FIELD("content-encoding", ""), FIELD("content-language", ""),
+    FIELD("content-length", ""), FIELD("content-location", ""), FIELD("content-range", ""),
+    FIELD("content-type", ""), FIELD("cookie", ""), FIELD("date", ""),
+    FIELD("etag", ""), FIELD("expect", ""), FIELD("expires", ""),
+    FIELD("from", ""), FIELD("host", ""), FIELD("if-match", ""),
+    FIELD("if-modified-since", ""), FIELD("if-none-match", ""), FIELD("if-range", ""),
+    FIELD("if-unmodified-since", ""), FIELD("last-modified", ""), FIELD("link", ""),
+    FIELD("location", ""), FIELD("max-forwards", ""), FIELD("proxy-authenticate", ""),
+    FIELD("proxy-authorization", ""), FIELD("range", ""), FIELD("referer", ""),
+    FIELD("refresh", ""), FIELD("retry-after", ""), FIELD("server", ""),
+    FIELD("set-cookie", ""), FIELD("strict-transport-security", ""), FIELD("transfer-encoding", ""),
+    FIELD("user-agent", ""), FIELD("vary", ""), FIELD("via", ""),
+    FIELD("www-authenticate", ""),
+};
+#undef FIELD
+#define STATIC_ENTRIES ((int) (sizeof(staticTable) / sizeof(staticTable[0])) - 1)
+
+// code length of every symbol, 256 is EOS. the code is canonical (appendix B assigns codes
+// in order of length, then symbol), so the lengths alone define it.
+static const unsigned char huffmanLengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+#define HUFFMAN_MAX_LEN 30
+
+// canonical decoding: the codes of one length are consecutive, starting at "firstCode".
+static uint32_t firstCode[HUFFMAN_MAX_LEN + 1];
+static uint32_t codeCount[HUFFMAN_MAX_LEN + 1];
+static uint32_t codeOffset[HUFFMAN_MAX_LEN + 1];
+static uint16_t symbolsByCode[257];
+static pthread_once_t huffmanOnce = PTHREAD_ONCE_INIT;
+
+static void huffmanBuild(void) {
+    for (int sym = 0; sym < 257; sym++)
+        codeCount[huffmanLengths[sym]]++;
+    uint32_t code = 0, offset = 0;
+    for (int len = 1; len <= HUFFMAN_MAX_LEN; len++) {
+        code = (code + codeCount[len - 1]) << 1;
+        firstCode[len] = code;
+        codeOffset[len] = offset;
+        offset += codeCount[len];
+    }
+    uint32_t filled[HUFFMAN_MAX_LEN + 1] = { 0 };
+    for (int sym = 0; sym < 257; sym++) {
+        const int len = huffmanLengths[sym];
+        symbolsByCode[codeOffset[len] + filled[len]++] = sym;
+    }
+}
+
+// returns the decoded length, -1 on EOS, a code that does not exist or bad padding.
+static long huffmanDecode(const unsigned char* p, size_t len, char* out) {
+    const unsigned char* end = p + len;
+    uint64_t window = 0;  // "bits" unread bits, left-aligned.
+    int bits = 0;
+    long n = 0;
+    while (1) {
+        for (; bits <= 56 && p < end; bits += 8)
+            window |= (uint64_t) *p++ << (56 - bits);
+        if (bits == 0)
+            return n;
+        int sym = -1;
+        for (int l = 5; l <= HUFFMAN_MAX_LEN && l <= bits; l++) {
+            const uint32_t code = window >> (64 - l);
+            if (code - firstCode[l] < codeCount[l]) {
+                sym = symbolsByCode[codeOffset[l] + code - firstCode[l]];
+                window <<= l;
+                bits -= l;
+                break;
+            }
+        }
+        if (sym < 0)  // only padding may be left: the most significant bits of EOS, under a byte.
+            return bits < 8 && window >> (64 - bits) == (1ULL << bits) - 1 ? n : -1;
+        if (sym == 256)
+            return -1;
+        out[n++] = (char) sym;
+    }
+}
+
+// an integer with an "prefix"-bit prefix, -1 if it is truncated or overflows.
+static long decodeInt(const unsigned char** p, const unsigned char* end, int prefix) {
+    const unsigned max = (1u << prefix) - 1;
+    long value = **p & max;
+    (*p)++;
+    if (value < max)
+        return value;
+    for (int shift = 0; *p < end && shift <= 21; shift += 7) {
+        const unsigned char b = *(*p)++;
+        value += (long) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return value;
+    }
+    return -1;
+}
+
+// a string literal, Huffman-coded ones are decoded into the scratch space at "*scratch".
+static int decodeString(const unsigned char** p, const unsigned char* end, char** scratch,
+                        const char** str, size_t* len) {
+    if (*p == end)
+        return -1;
+    const int huffman = **p & 0x80;
+    const long n = decodeInt(p, end, 7);
+    if (n < 0 || n > end - *p)
+        return -1;
+    if (huffman) {
+        pthread_once(&huffmanOnce, huffmanBuild);
+        const long decoded = huffmanDecode(*p, n, *scratch);
+        if (decoded < 0)
+            return -1;
+        *str = *scratch;
+        *len = decoded;
+        *scratch += decoded;
+    } else {
+        *str = (const char*) *p;
+        *len = n;
+    }
+    *p += n;
+    return 0;
+}
+
+void hpackDecoderInit(hpackDecoder* hd) {
+    memset(hd, 0, sizeof(hpackDecoder));
+    hd->maxSize = HPACK_TABLE_SIZE;
+}
+
+static void evict(hpackDecoder* hd, size_t limit) {
+    while (hd->size > limit) {
+        hpackEntry* oldest = hd->entries[(hd->first + hd->count - 1) % HPACK_MAX_ENTRIES];
+        hd->size -= 32 + oldest->nameLen + oldest->valueLen;
+        hd->count--;
+        free(oldest);
+    }
+}
+
+void hpackDecoderRelease(hpackDecoder* hd) {
+    evict(hd, 0);
+    free(hd->scratch);
+    hd->scratch = NULL;
+}
+
+static void insert(hpackDecoder* hd, const char* name, size_t nameLen, const char* value, size_t valueLen) {
+    const size_t size = 32 + nameLen + valueLen;
+    // copied before evicting, the name may belong to an entry that is about to go.
+    hpackEntry* e = size <= hd->maxSize ? malloc(sizeof(hpackEntry) + nameLen + valueLen) : NULL;
+    if (e != NULL) {
+        e->nameLen = nameLen;
+        e->valueLen = valueLen;
+        memcpy(e->data, name, nameLen);
+        memcpy(e->data + nameLen, value, valueLen);
+    }
+    evict(hd, e != NULL ? hd->maxSize - size : 0);
+    if (e == NULL)
+        return;  // an entry larger than the table just empties it.
+    hd->first = (hd->first + HPACK_MAX_ENTRIES - 1) % HPACK_MAX_ENTRIES;
+    hd->entries[hd->first] = e;
+    hd->count++;
+    hd->size += size;
+}
+
+static int lookup(const hpackDecoder* hd, long index, const char** name, size_t* nameLen,
+                  const char** value, size_t* valueLen) {
+    if (index >= 1 && index <= STATIC_ENTRIES) {
+        *name = staticTable[index].name;
+        *nameLen = staticTable[index].nameLen;
+        *value = staticTable[index].value;
+        *valueLen = staticTable[index].valueLen;
+        return 0;
+    }
+    index -= STATIC_ENTRIES + 1;
+    if (index < 0 || index >= hd->count)
+        return -1;
+    const hpackEntry* e = hd->entries[(hd->first + index) % HPACK_MAX_ENTRIES];
+    *name = e->data;
+    *nameLen = e->nameLen;
+    *value = e->data + e->nameLen;
+    *valueLen = e->valueLen;
+    return 0;
+}
+
+// decodes a complete header block, calling "fn" per field, -1 on a compression error.
+int hpackDecode(hpackDecoder* hd, const unsigned char* p, size_t len, hpackFieldFn fn, void* arg) {
+    // huffman codes are at least 5 bits long, so no block decodes to more than 8/5 of its size.
+    const size_t need = len * 8 / 5 + 1;
+    if (need > hd->scratchCap) {
+        char* grown = realloc(hd->scratch, need);
+        if (grown == NULL)
+            return -1;
+        hd->scratch = grown;
+        hd->scratchCap = need;
+    }
+    char* scratch = hd->scratch;
+    const unsigned char* end = p + len;
+    int fields = 0;
+    while (p < end) {
+        const char *name, *value;
+        size_t nameLen, valueLen;
+        const unsigned char b = *p;
+        if (b & 0x80) {
+            // indexed field.
+            const long index = decodeInt(&p, end, 7);
+            if (lookup(hd, index, &name, &nameLen, &value, &valueLen) < 0)
+                return -1;
+        } else if ((b & 0xe0) == 0x20) {
+            // dynamic table size update, only before the first field.
+            const long size = decodeInt(&p, end, 5);
+            if (fields > 0 || size < 0 || size > HPACK_TABLE_SIZE)
+                return -1;
+            hd->maxSize = size;
+            evict(hd, size);
+            continue;
+        } else {
+            // literal, with incremental indexing (01), without (0000) or never indexed (0001).
+            const int indexing = (b & 0xc0) == 0x40;
+            const long index = decodeInt(&p, end, indexing ? 6 : 4);
+            if (index < 0)
+                return -1;
+            if (index == 0) {
+                if (decodeString(&p, end, &scratch, &name, &nameLen) < 0)
+                    return -1;
+            } else if (lookup(hd, index, &name, &nameLen, &value, &valueLen) < 0) {
+                return -1;
+            }
+            if (decodeString(&p, end, &scratch, &value, &valueLen) < 0)
+                return -1;
+            if (indexing) {
+                // handed over first, inserting may evict the entry the name came from.
+                fn(arg, name, nameLen, value, valueLen);
+                insert(hd, name, nameLen, value, valueLen);
+                fields++;
+                continue;
+            }
+        }
+        fn(arg, name, nameLen, value, valueLen);
+        fields++;
+    }
+    return 0;
+}
+
+static size_t encodeInt(unsigned char* out, unsigned char flags, int prefix, size_t value) {
+    const size_t max = (1u << prefix) - 1;
+    if (value < max) {
+        out[0] = flags | value;
+        return 1;
+    }
+    size_t n = 0;
+    out[n++] = flags | max;
+    for (value -= max; value >= 0x80; value >>= 7)
+        out[n++] = (value & 0x7f) | 0x80;
+    out[n++] = value;
+    return n;
+}
+
+// ":status", a single byte for the codes the static table has.
+size_t hpackEncodeStatus(unsigned char* out, int status) {
+    switch (status) {
+        case 200: return encodeInt(out, 0x80, 7, HPACK_STATUS);
+        case 204: return encodeInt(out, 0x80, 7, HPACK_STATUS + 1);
+        case 206: return encodeInt(out, 0x80, 7, HPACK_STATUS + 2);
+        case 304: return encodeInt(out, 0x80, 7, HPACK_STATUS + 3);
+        case 400: return encodeInt(out, 0x80, 7, HPACK_STATUS + 4);
+        case 404: return encodeInt(out, 0x80, 7, HPACK_STATUS + 5);
+        case 500: return encodeInt(out, 0x80, 7, HPACK_STATUS + 6);
+        default: break;
+    }
+    const char digits[3] = { '0' + status / 100 % 10, '0' + status / 10 % 10, '0' + status % 10 };
+    return hpackEncodeField(out, HPACK_STATUS, digits, 3);
+}
+
+// a literal without indexing whose name is the static entry "nameIndex", the value is sent raw.
+size_t hpackEncodeField(unsigned char* out, int nameIndex, const char* value, size_t len) {
+    size_t n = encodeInt(out, 0x00, 4, nameIndex);
+    n += encodeInt(out + n, 0x00, 7, len);
+    memcpy(out + n, value, len);
+    return n + len;
+}
+
+// a literal without indexing with a name of its own, such as an "x-" header. both are sent raw.
+size_t hpackEncodeNamed(unsigned char* out, const char* name, size_t nameLen, const char* value, size_t len) {
+    size_t n = encodeInt(out, 0x00, 4, 0);
+    n += encodeInt(out + n, 0x00, 7, nameLen);
+    memcpy(out + n, name, nameLen);
+    n += nameLen;
+    n += encodeInt(out + n, 0x00, 7, len);
+    memcpy(out + n, value, len);
+    return n + len;
+}
@@ -0,0 +1,26 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_HPACK_H
+#define THINKING_IN_C_HPACK_H
+
+#include <stddef.h>
+#include "structs.h"
+
+// static table indices the encoder refers to (RFC 7541 appendix A).
+#define HPACK_STATUS 8
+#define HPACK_CONTENT_LENGTH 28
+#define HPACK_CONTENT_TYPE 31
+#define HPACK_LAST_MODIFIED 44
+
+typedef void (*hpackFieldFn)(void* arg, const char* name, size_t nameLen, const char* value, size_t valueLen);
+
+void hpackDecoderInit(hpackDecoder*);
+void hpackDecoderRelease(hpackDecoder*);
+int hpackDecode(hpackDecoder*, const unsigned char*, size_t, hpackFieldFn, void*);
+size_t hpackEncodeStatus(unsigned char*, int);
+size_t hpackEncodeField(unsigned char*, int, const char*, size_t);
+size_t hpackEncodeNamed(unsigned char*, const char*, size_t, const char*, size_t);
+
+#endif //THINKING_IN_C_HPACK_H
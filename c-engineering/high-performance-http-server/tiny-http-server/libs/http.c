@@ -0,0 +1,55 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <stddef.h>
+#include "http.h"
+#include "scan.h"
+
+// splits "METHOD SP request-target SP HTTP-version [CR]LF", all spans point into "line".
+int httpParseRequestLine(const char* line, size_t len, httpRequestLine* rl) {
+    const char* end = line + len;
+    while (end > line && (end[-1] == '\n' || end[-1] == '\r'))
+        end--;
+    const char* methodTail = scanDelims(line, end, " ");
+    if (methodTail == end || methodTail == line)
+        return -1;
+    const char* targetHead = methodTail + 1;
+    const char* targetTail = scanDelims(targetHead, end, " ");
+    if (targetTail == end || targetTail == targetHead)
+        return -1;
+    rl->method = (strSpan) { line, methodTail - line };
+    rl->target = (strSpan) { targetHead, targetTail - targetHead };
+    rl->version = (strSpan) { targetTail + 1, end - targetTail - 1 };
+
+    // path ends at the query or the fragment, the query ends at the fragment.
+    const char* pathTail = scanDelims(targetHead, targetTail, "?#");
+    rl->path = (strSpan) { targetHead, pathTail - targetHead };
+    rl->query = (strSpan) { targetTail, 0 };
+    if (pathTail != targetTail && *pathTail == '?') {
+        const char* queryTail = scanDelims(pathTail + 1, targetTail, "#");
+        rl->query = (strSpan) { pathTail + 1, queryTail - pathTail - 1 };
+    }
+    return 0;
+}
+
+static const char* trimOWS(const char* head, const char** tail) {
+    while (head < *tail && (*head == ' ' || *head == '\t'))
+        head++;
+    while (*tail > head && ((*tail)[-1] == ' ' || (*tail)[-1] == '\t' || (*tail)[-1] == '\r'))
+        (*tail)--;
+    return head;
+}
+
+// parses the header line at "p", returns where the next one starts,
+// or NULL at the blank line closing the head (and on a malformed line).
+const char* httpNextHeader(const char* p, const char* end, strSpan* name, strSpan* value) {
+    const char* hit = scanDelims(p, end, ":\n");
+    if (hit == end || *hit == '\n')
+        return NULL;
+    const char* newline = scanDelims(hit + 1, end, "\n");
+    const char* valueTail = newline;
+    const char* valueHead = trimOWS(hit + 1, &valueTail);
+    *name = (strSpan) { p, hit - p };
+    *value = (strSpan) { valueHead, valueTail - valueHead };
+    return newline == end ? end : newline + 1;
+}
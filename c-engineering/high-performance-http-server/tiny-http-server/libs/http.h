@@ -0,0 +1,13 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_HTTP_H
+#define THINKING_IN_C_HTTP_H
+
+#include "structs.h"
+
+int httpParseRequestLine(const char*, size_t, httpRequestLine*);
+const char* httpNextHeader(const char*, const char*, strSpan*, strSpan*);
+
+#endif //THINKING_IN_C_HTTP_H
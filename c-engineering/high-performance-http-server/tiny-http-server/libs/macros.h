@@ -10,5 +10,105 @@
 #define MAX_LISTEN_CONN 128
 #define HTTP_REQ_BUF 1024
 #define HTTP_RES_BUF 1024
+#define HTTP_MAX_HEADER_BYTES 8192
+#define MAX_EPOLL_EVENTS 64
+#define ACCEPT_BATCH 16
+#define ACCEPT_PAUSE_MS 100  // out of descriptors, a worker stops accepting for this long.
+#define KEEPALIVE_REQUESTS 1000  // per connection, then it is closed and the client reconnects.
+#define WRITE_TIMEOUT_MS 10000  // a client that takes none of its response for this long is dropped.
+#define WRITE_SWEEP_MS 1000  // how often a worker looks for such clients while any is behind.
+#define WRITE_IOVS 16  // segments of pending output handed to one writev.
+
+// what "handleRequest" looks for among the request headers.
+#define HEAD_KEEP_ALIVE 0x1
+#define HEAD_BODY 0x2
+#define HEAD_UPGRADE_H2C 0x4
+#define HEAD_CLOSE 0x8
+
+// micro-batched fibonacci, F(93) is the largest that fits 64 bits.
+#define BATCH_FIB_LIMIT 94
+#define BATCH_MAX 64
+#define BATCH_DIGITS 24  // F(93) has 20 digits.
+
+// "/fibmod" reduces n by the Pisano period of moduli up to this, and caches the periods.
+#define PISANO_MAX 65536
+
+// big-integer fibonacci, decimal limbs so the digits need no conversion. an algorithm is used
+// once the shorter operand has at least this many limbs.
+#define BIG_BASE 100000000U
+#define BIG_BASE_DIGITS 8
+#define BIG_KARATSUBA_MIN 32
+#define BIG_TOOM3_MIN 200
+#define BIG_NTT_MIN 1000
+#define BIG_PARALLEL_MIN 20000  // below this, handing work to the compute pool costs more than it saves.
+#define MAX_NUM 10000000  // F(10^7) has 2089877 digits.
+#define FIB_INT_MAX 46  // the largest F(n) the built-in int kernel holds.
+
+// overload degradation: a worker whose smoothed queue time crosses "degrade_queue_us" answers
+// uncached F(n) with Binet's formula, and goes back to exact values below half of it.
+#define DEGRADE_TOLERANCE 1e-8  // the largest relative error an estimate may carry, F(10^7) needs 1.6e-9.
+#define DEGRADE_SMOOTHING 8  // each queue-time sample moves the average by 1/8 of the difference.
+
+// compute pool.
+#define COMPUTE_MAX_THREADS 64
+#define COMPUTE_QUEUE 256
+
+// memory pools.
+#define POOL_PAGE_SIZE 4096
+#define POOL_BUF_CLASSES 3
+#define POOL_ARENA_SIZE (2 * 1024 * 1024)
+#define POOL_BATCH 32
+#define POOL_MAX_NODES 8
+#define POOL_MPOL_PREFERRED 1  // MPOL_PREFERRED from <numaif.h>, without requiring libnuma.
+#define CHAIN_SEG_MAX (POOL_PAGE_SIZE << (2 * (POOL_BUF_CLASSES - 1)))
+
+// shared fibonacci memo.
+#define MEMO_SLOTS (1 << 20)
+#define MEMO_ARENA_SIZE (256ULL * 1024 * 1024)
+
+// persistent result store, values cheaper than this are not worth a disk write.
+#define STORE_MIN_MICROS 1000
+
+// shared statistics, a reader gives up on a slot whose seqlock never settles.
+#define STATS_READ_RETRIES 1000
+
+// hot restart.
+#define HANDOFF_MAX_FDS 4
+#define HANDOFF_DRAIN_SECONDS 30
+
+// worker autoscaling.
+#define MAX_WORKER_THREADS 256
+#define SCALE_INTERVAL_MS 1000
+#define SCALE_UP_UTILISATION 0.80
+#define SCALE_DOWN_UTILISATION 0.30
+#define SCALE_SATURATED_RUN_DELAY 0.20
+#define SCALE_UP_SAMPLES 2
+#define SCALE_DOWN_SAMPLES 5
+
+// request capture.
+#define CAPTURE_MAX_BYTES (1ULL << 30)
+#define CAPTURE_MAX_SEGS 16
+
+// static files.
+#define STATIC_CACHE_SLOTS 1024
+#define STATIC_MAX_PATH 256
+#define STATIC_HEADER_MAX 256
+#define STATIC_MAX_DIRS 64
+
+// HTTP/2 (h2c).
+#define H2_DEFAULT_STREAMS 256  // SETTINGS_MAX_CONCURRENT_STREAMS unless "h2_max_streams" says otherwise.
+#define H2_MAX_STREAMS 1024
+#define H2_FRAME_SIZE 16384  // SETTINGS_MAX_FRAME_SIZE, the protocol's default and minimum.
+#define H2_SETTINGS_MAX 128  // a longer "HTTP2-Settings" is ignored, all six settings take 48 characters.
+#define H2_DEFAULT_WINDOW 65535
+#define H2_MAX_WINDOW 0x7fffffff
+#define HPACK_TABLE_SIZE 4096
+#define HPACK_MAX_ENTRIES (HPACK_TABLE_SIZE / 32)  // every entry costs at least 32 bytes.
+
+// compute plugins, the active one and older ones a worker is still inside.
+#define PLUGIN_SLOTS 4
+
+// cpu placement.
+#define MAX_PINNED_CPUS 256
 
 #endif //THINKING_IN_C_MACROS_H
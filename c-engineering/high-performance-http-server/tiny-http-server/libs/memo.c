@@ -0,0 +1,105 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "memo.h"
+#include "macros.h"
+
+// the table is shared by every process that maps it: an anonymous one is inherited by
+// prefork workers (and passed on by a hot restart), a file (e.g. under /dev/shm) is shared by unrelated http-server processes.
+// an all-zero mapping is a valid empty table, so whoever maps it first needs no set-up step.
+typedef struct {
+    atomic_ullong magic;
+    atomic_ullong used;
+    atomic_ullong index[MEMO_SLOTS];  // 0 when absent, otherwise record offset + 1.
+} memoHeader;
+
+typedef struct {
+    uint32_t len;
+    char digits[];
+} memoRecord;
+
+#define MEMO_MAGIC 0x6669626d656d6f01ULL  // "fibmemo" + layout version.
+#define MEMO_BYTES (sizeof(memoHeader) + MEMO_ARENA_SIZE)
+
+static memoHeader* memo = NULL;
+static char* arena = NULL;
+
+static int memoFileDesc = -1;
+
+// maps a table someone already set up, e.g. one handed over by the previous process.
+int memoAttach(int fd) {
+    struct stat st;
+    // sparse, pages are only backed once records land on them.
+    if (fstat(fd, &st) < 0 || ((size_t) st.st_size < MEMO_BYTES && ftruncate(fd, MEMO_BYTES) < 0))
+        return -1;
+    void* mem = mmap(NULL, MEMO_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+        return -1;
+
+    memoHeader* header = mem;
+    unsigned long long expected = 0;
+    if (!atomic_compare_exchange_strong(&header->magic, &expected, MEMO_MAGIC) && expected != MEMO_MAGIC) {
+        munmap(mem, MEMO_BYTES);  // written by an incompatible build.
+        return -1;
+    }
+    arena = (char*) mem + sizeof(memoHeader);
+    memo = header;
+    memoFileDesc = fd;
+    return 0;
+}
+
+// "path" is NULL for an anonymous table (a memfd, so it can still be handed to a successor),
+// returns -1 if the table cannot be used.
+int memoInit(const char* path) {
+    const int fd = path == NULL ? memfd_create("fib-memo", MFD_CLOEXEC) : open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (memoAttach(fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+int memoFd(void) {
+    return memoFileDesc;
+}
+
+// lock-free, returns the digits in place or NULL when "n" has not been computed yet.
+const char* memoGet(long n, size_t* len) {
+    if (memo == NULL || n < 0 || n >= MEMO_SLOTS)
+        return NULL;
+    const unsigned long long at = atomic_load_explicit(&memo->index[n], memory_order_acquire);
+    if (at == 0)
+        return NULL;
+    const memoRecord* rec = (const memoRecord*) (arena + at - 1);
+    *len = rec->len;
+    return rec->digits;
+}
+
+// the record is written into freshly reserved space and only then published through the index,
+// so readers see either nothing or the complete value. losing a publish race wastes the space.
+int memoPut(long n, const char* digits, size_t len) {
+    if (memo == NULL || n < 0 || n >= MEMO_SLOTS)
+        return -1;
+    if (atomic_load_explicit(&memo->index[n], memory_order_relaxed) != 0)
+        return 0;
+    const size_t recSize = (sizeof(memoRecord) + len + 7) & ~(size_t) 7;
+    const unsigned long long at = atomic_fetch_add_explicit(&memo->used, recSize, memory_order_relaxed);
+    if (at + recSize > MEMO_ARENA_SIZE)
+        return -1;  // full, the table keeps serving what it has.
+    memoRecord* rec = (memoRecord*) (arena + at);
+    rec->len = (uint32_t) len;
+    memcpy(rec->digits, digits, len);
+    unsigned long long absent = 0;
+    atomic_compare_exchange_strong_explicit(&memo->index[n], &absent, at + 1, memory_order_release, memory_order_relaxed);
+    return 0;
+}
@@ -0,0 +1,16 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_MEMO_H
+#define THINKING_IN_C_MEMO_H
+
+#include <stddef.h>
+
+int memoInit(const char*);
+int memoAttach(int);
+int memoFd(void);
+const char* memoGet(long, size_t*);
+int memoPut(long, const char*, size_t);
+
+#endif //THINKING_IN_C_MEMO_H
@@ -0,0 +1,165 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "macros.h"
+#include "plugin.h"
+
+// a loaded plugin moves from live (the active one, or one being loaded) to retired when a newer
+// one replaces it, and back to free once the last worker inside it has left and it is unloaded.
+enum { SLOT_FREE, SLOT_LIVE, SLOT_RETIRED, SLOT_CLOSING };
+
+typedef struct {
+    atomic_int state;
+    atomic_int users;  // workers between "pluginAcquire" and "pluginRelease".
+    _Atomic(const computePlugin*) plugin;  // "view" while loaded, NULL when free.
+    computePlugin view;  // the plugin's own, with the fields it predates left NULL.
+    void* handle;
+    int fd;
+} pluginSlot;
+
+static pluginSlot slots[PLUGIN_SLOTS];
+static _Atomic(pluginSlot*) active = NULL;
+
+// dlopen returns the already loaded object for a name it has seen, so a rebuilt plugin at the
+// same path would never be picked up. each load therefore maps its own memfd copy of the file.
+static int copyToMemfd(const char* path) {
+    const int src = open(path, O_RDONLY | O_CLOEXEC);
+    if (src < 0)
+        return -1;
+    const int dst = memfd_create("compute-plugin", MFD_CLOEXEC);
+    char buf[65536];
+    ssize_t n = 0;
+    while (dst >= 0 && (n = read(src, buf, sizeof(buf))) > 0)
+        if (write(dst, buf, n) != n)
+            break;
+    close(src);
+    if (dst >= 0 && n != 0) {
+        close(dst);
+        return -1;
+    }
+    return dst;
+}
+
+// unloads a retired plugin nobody is inside. a worker that raced in here only to find the slot
+// no longer active leaves without calling it, and if it is still in when we look, its
+// "pluginRelease" tries again.
+static void slotReclaim(pluginSlot* slot) {
+    while (atomic_load(&slot->users) == 0) {
+        int expected = SLOT_RETIRED;
+        if (!atomic_compare_exchange_strong(&slot->state, &expected, SLOT_CLOSING))
+            return;
+        if (atomic_load(&slot->users) == 0) {
+            dlclose(slot->handle);
+            close(slot->fd);
+            atomic_store(&slot->plugin, NULL);
+            atomic_store(&slot->state, SLOT_FREE);
+            return;
+        }
+        atomic_store(&slot->state, SLOT_RETIRED);
+    }
+}
+
+// the last worker to leave a retired plugin unloads it.
+static void slotLeave(pluginSlot* slot) {
+    if (atomic_fetch_sub(&slot->users, 1) == 1 && atomic_load(&slot->state) == SLOT_RETIRED)
+        slotReclaim(slot);
+}
+
+// loads the plugin at "path" and makes it the active one. runs off the request path: workers
+// keep calling the previous plugin until the pointer swap and never wait for the load. the
+// previous one is unloaded as soon as no worker is inside it.
+int pluginLoad(const char* path) {
+    pluginSlot* slot = NULL;
+    for (int i = 0; i < PLUGIN_SLOTS && slot == NULL; i++) {
+        slotReclaim(&slots[i]);  // one whose last user left while another was closing it.
+        int expected = SLOT_FREE;
+        if (atomic_compare_exchange_strong(&slots[i].state, &expected, SLOT_LIVE))
+            slot = &slots[i];
+    }
+    if (slot == NULL) {
+        fprintf(stderr, "[Warn] Plugin \"%s\" not loaded, the older ones are still in use.\n", path);
+        return -1;
+    }
+    const int fd = copyToMemfd(path);
+    if (fd < 0) {
+        perror("In pluginLoad");
+        atomic_store(&slot->state, SLOT_FREE);
+        return -1;
+    }
+    char procPath[64];
+    snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", fd);  // unique while "fd" stays open.
+    void* handle = dlopen(procPath, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "[Warn] Plugin \"%s\": %s\n", path, dlerror());
+        close(fd);
+        atomic_store(&slot->state, SLOT_FREE);
+        return -1;
+    }
+    dlerror();
+    const pluginEntryFn entry = (pluginEntryFn) dlsym(handle, PLUGIN_ENTRY);
+    const char* error = dlerror();
+    const computePlugin* plugin = error == NULL ? entry() : NULL;
+    if (plugin != NULL && plugin->abiVersion == PLUGIN_ABI_VERSION && plugin->size >= offsetof(computePlugin, fibDigits)) {
+        memset(&slot->view, 0, sizeof(slot->view));
+        memcpy(&slot->view, plugin, plugin->size < sizeof(computePlugin) ? plugin->size : sizeof(computePlugin));
+        plugin = &slot->view;
+    } else {
+        plugin = NULL;
+    }
+    if (plugin == NULL || (plugin->fibDigits == NULL && plugin->fibMod == NULL)) {
+        fprintf(stderr, "[Warn] Plugin \"%s\" is not a compute plugin of ABI version %d.\n", path, PLUGIN_ABI_VERSION);
+        dlclose(handle);
+        close(fd);
+        atomic_store(&slot->state, SLOT_FREE);
+        return -1;
+    }
+    atomic_store(&slot->plugin, plugin);
+    slot->handle = handle;
+    slot->fd = fd;
+    pluginSlot* previous = atomic_exchange(&active, slot);
+    printf("[Info] Compute plugin \"%s\" loaded%s%s.\n", plugin->name,
+           previous != NULL ? ", replacing " : "", previous != NULL ? atomic_load(&previous->plugin)->name : "");
+    fflush(stdout);
+    if (previous != NULL) {
+        atomic_store(&previous->state, SLOT_RETIRED);
+        slotReclaim(previous);
+    }
+    return 0;
+}
+
+// whether a plugin is loaded, not to be called through.
+const computePlugin* pluginActive(void) {
+    const pluginSlot* slot = atomic_load(&active);
+    return slot != NULL ? atomic_load(&slot->plugin) : NULL;
+}
+
+// the active plugin, kept loaded until the matching "pluginRelease". a worker counts itself in
+// first and only uses the slot if it is still the active one, so a reload never unloads it
+// under the worker.
+const computePlugin* pluginAcquire(void) {
+    pluginSlot* slot;
+    while ((slot = atomic_load(&active)) != NULL) {
+        atomic_fetch_add(&slot->users, 1);
+        if (atomic_load(&active) == slot)
+            return atomic_load(&slot->plugin);
+        slotLeave(slot);  // replaced meanwhile, try the new one.
+    }
+    return NULL;
+}
+
+void pluginRelease(const computePlugin* plugin) {
+    for (int i = 0; plugin != NULL && i < PLUGIN_SLOTS; i++)
+        if (atomic_load(&slots[i].plugin) == plugin) {
+            slotLeave(&slots[i]);
+            return;
+        }
+}
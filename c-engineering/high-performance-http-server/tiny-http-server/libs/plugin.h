@@ -0,0 +1,38 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_PLUGIN_H
+#define THINKING_IN_C_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the ABI between the server and a compute plugin. a plugin exports PLUGIN_ENTRY, a function
+// returning its "computePlugin". fields are only ever appended, a plugin built against an older
+// header reports a smaller "size" and the server treats the fields past it as NULL; a change
+// that breaks existing fields bumps PLUGIN_ABI_VERSION and old plugins are refused.
+#define PLUGIN_ABI_VERSION 2
+#define PLUGIN_ENTRY "computePluginEntry"
+
+// every kernel may be NULL, and one that returns -1 leaves the value to the built-in one.
+typedef struct {
+    unsigned abiVersion;
+    size_t size;  // sizeof(computePlugin) as the plugin saw it.
+    const char* name;
+    // writes the decimal digits of F(n) and a NUL into "buf" and returns the digit count,
+    // -1 when n is out of the kernel's range. as with snprintf, a count of "cap" or more means
+    // "buf" was too small; the server then calls again with room for that many.
+    long (*fibDigits)(long n, char* buf, size_t cap);
+    // F(n) mod m into "residue", m is never 0.
+    int (*fibMod)(uint64_t n, uint64_t m, uint64_t* residue);
+} computePlugin;
+
+typedef const computePlugin* (*pluginEntryFn)(void);
+
+int pluginLoad(const char*);
+const computePlugin* pluginActive(void);
+const computePlugin* pluginAcquire(void);
+void pluginRelease(const computePlugin*);
+
+#endif //THINKING_IN_C_PLUGIN_H
@@ -0,0 +1,223 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+#include "chain.h"
+#include "macros.h"
+
+// every free object doubles as a node of the free list it sits on.
+typedef struct slabNode {
+    struct slabNode* next;
+} slabNode;
+
+typedef struct {
+    pthread_mutex_t lock;
+    slabNode* head;
+} slabDepot;
+
+// a cache hands out fixed-size objects carved from mmap'd arenas.
+// threads keep a private free list and only touch the shared depot of their
+// NUMA node (under its lock) to move a whole batch in or out.
+typedef struct {
+    int id;
+    size_t objSize;
+    slabDepot depots[POOL_MAX_NODES];
+} slabCache;
+
+typedef struct {
+    slabNode* head;
+    size_t count;
+} localList;
+
+static int poolFlags = 0;
+static slabCache bufCaches[POOL_BUF_CLASSES];
+static slabCache connCache;
+static _Thread_local localList localLists[POOL_BUF_CLASSES + 1];
+static _Thread_local int localNode = 0;
+
+// keeps an arena's pages on "node", first touch would mostly do it but not for a thread that migrates.
+static void bindArena(void* arena, size_t size, int node) {
+#ifdef SYS_mbind
+    if (!(poolFlags & POOL_NUMA))
+        return;
+    const unsigned long mask = 1UL << node;
+    syscall(SYS_mbind, arena, size, POOL_MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+#else
+    (void) arena;
+    (void) size;
+    (void) node;
+#endif
+}
+
+static void* mapArena(size_t size) {
+    void* arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (poolFlags & POOL_HUGEPAGES)
+        arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (arena == MAP_FAILED) {
+        // no reserved huge pages, fall back to normal ones (THP may still back them).
+        arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        if (poolFlags & POOL_HUGEPAGES)
+            madvise(arena, size, MADV_HUGEPAGE);
+#endif
+    }
+    return arena;
+}
+
+static void cacheInit(slabCache* sc, int id, size_t objSize) {
+    sc->id = id;
+    sc->objSize = objSize;
+    for (int i = 0; i < POOL_MAX_NODES; i++) {
+        sc->depots[i].head = NULL;
+        pthread_mutex_init(&sc->depots[i].lock, NULL);
+    }
+}
+
+// called with the depot lock held.
+static int cacheGrow(slabCache* sc, slabDepot* depot) {
+    const size_t arenaSize = sc->objSize > POOL_ARENA_SIZE ? sc->objSize : POOL_ARENA_SIZE;
+    char* arena = mapArena(arenaSize);
+    if (arena == NULL)
+        return -1;
+    bindArena(arena, arenaSize, localNode);
+    for (size_t off = 0; off + sc->objSize <= arenaSize; off += sc->objSize) {
+        slabNode* node = (slabNode*) (arena + off);
+        node->next = depot->head;
+        depot->head = node;
+    }
+    return 0;
+}
+
+static void* cacheAlloc(slabCache* sc) {
+    localList* ll = &localLists[sc->id];
+    if (ll->head == NULL) {
+        // refill a batch from the depot.
+        slabDepot* depot = &sc->depots[localNode];
+        pthread_mutex_lock(&depot->lock);
+        if (depot->head == NULL && cacheGrow(sc, depot) < 0) {
+            pthread_mutex_unlock(&depot->lock);
+            return NULL;
+        }
+        while (depot->head != NULL && ll->count < POOL_BATCH) {
+            slabNode* node = depot->head;
+            depot->head = node->next;
+            node->next = ll->head;
+            ll->head = node;
+            ll->count++;
+        }
+        pthread_mutex_unlock(&depot->lock);
+    }
+    slabNode* node = ll->head;
+    ll->head = node->next;
+    ll->count--;
+    return node;
+}
+
+static void cacheFlush(slabCache* sc, size_t keep) {
+    localList* ll = &localLists[sc->id];
+    if (ll->count <= keep)
+        return;
+    slabDepot* depot = &sc->depots[localNode];
+    pthread_mutex_lock(&depot->lock);
+    while (ll->count > keep) {
+        slabNode* node = ll->head;
+        ll->head = node->next;
+        ll->count--;
+        node->next = depot->head;
+        depot->head = node;
+    }
+    pthread_mutex_unlock(&depot->lock);
+}
+
+static void cacheFree(slabCache* sc, void* obj) {
+    localList* ll = &localLists[sc->id];
+    slabNode* node = obj;
+    node->next = ll->head;
+    ll->head = node;
+    // give half back once the thread hoards too much.
+    if (++ll->count >= 2 * POOL_BATCH)
+        cacheFlush(sc, POOL_BATCH);
+}
+
+static int bufClassOf(size_t size) {
+    for (int i = 0; i < POOL_BUF_CLASSES; i++)
+        if (size <= ((size_t) POOL_PAGE_SIZE << (2 * i)))
+            return i;
+    return -1;
+}
+
+void poolInit(int flags) {
+    poolFlags = flags;
+    // classes: 4 KiB, 16 KiB, 64 KiB, all page-aligned.
+    for (int i = 0; i < POOL_BUF_CLASSES; i++)
+        cacheInit(&bufCaches[i], i, (size_t) POOL_PAGE_SIZE << (2 * i));
+    // round connection objects up to a cache line so they never share one.
+    cacheInit(&connCache, POOL_BUF_CLASSES, (sizeof(connection) + 63) & ~(size_t) 63);
+}
+
+// from now on the calling thread refills from (and flushes to) the depots of "node".
+void poolBindNode(int node) {
+    if (node < 0 || node >= POOL_MAX_NODES || !(poolFlags & POOL_NUMA))
+        return;
+    poolThreadFlush();  // cached objects belong to the old node.
+    localNode = node;
+}
+
+void poolThreadFlush(void) {
+    for (int i = 0; i < POOL_BUF_CLASSES; i++)
+        cacheFlush(&bufCaches[i], 0);
+    cacheFlush(&connCache, 0);
+}
+
+void* poolAllocBuf(size_t size, size_t* capacity) {
+    const int cls = bufClassOf(size);
+    if (cls < 0)
+        return NULL;
+    void* buf = cacheAlloc(&bufCaches[cls]);
+    if (buf != NULL && capacity != NULL)
+        *capacity = bufCaches[cls].objSize;
+    return buf;
+}
+
+void poolFreeBuf(void* buf, size_t capacity) {
+    if (buf != NULL)
+        cacheFree(&bufCaches[bufClassOf(capacity)], buf);
+}
+
+connection* connAcquire(int fd) {
+    connection* conn = cacheAlloc(&connCache);
+    if (conn == NULL)
+        return NULL;
+    conn->fd = fd;
+    conn->h2 = NULL;
+    conn->served = 0;
+    conn->batched = 0;
+    conn->file = NULL;
+    conn->blocked = 0;
+    conn->closing = 0;
+    chainInit(&conn->out);
+    // request segments are only attached once bytes arrive.
+    chainInit(&conn->in);
+    headParserInit(&conn->parser, &conn->in);
+    conn->resBuf = poolAllocBuf(HTTP_RES_BUF, &conn->resCap);
+    if (conn->resBuf == NULL) {
+        connRelease(conn);
+        return NULL;
+    }
+    return conn;
+}
+
+void connRelease(connection* conn) {
+    chainRelease(&conn->in);
+    chainRelease(&conn->out);
+    poolFreeBuf(conn->resBuf, conn->resCap);
+    cacheFree(&connCache, conn);
+}
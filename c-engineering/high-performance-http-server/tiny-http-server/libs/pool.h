@@ -0,0 +1,23 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_POOL_H
+#define THINKING_IN_C_POOL_H
+
+#include <stddef.h>
+#include "structs.h"
+
+// flags for "poolInit".
+#define POOL_HUGEPAGES 0x1
+#define POOL_NUMA 0x2
+
+void poolInit(int);
+void poolBindNode(int);
+void poolThreadFlush(void);
+void* poolAllocBuf(size_t, size_t*);
+void poolFreeBuf(void*, size_t);
+connection* connAcquire(int);
+void connRelease(connection*);
+
+#endif //THINKING_IN_C_POOL_H
@@ -0,0 +1,34 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <stdint.h>
+#include <string.h>
+#include "router.h"
+
+// "n" (at most 8) bytes of the path as one integer, so the generated code compares words, not strings.
+static inline uint64_t routeWord(const char* p, size_t n) {
+    uint64_t word = 0;
+    memcpy(&word, p, n);
+    return word;
+}
+
+// defines "routeDispatch", generated from "routes.def".
+#include "routes_gen.h"
+
+static const char* const routePaths[] = {
+#define ROUTE(id, path) path,
+#define ROUTE_PREFIX(id, path) path,
+#include "routes.def"
+#undef ROUTE
+#undef ROUTE_PREFIX
+};
+
+// O(1): a switch over the length, one over the byte(s) that tell the routes of that length apart,
+// then a word-wise check of the only candidate left; a miss falls through to the prefix routes.
+routeId routeLookup(const char* path, size_t len) {
+    return routeDispatch(path, len);
+}
+
+const char* routePath(routeId id) {
+    return id >= 0 && id < ROUTE_COUNT ? routePaths[id] : NULL;
+}
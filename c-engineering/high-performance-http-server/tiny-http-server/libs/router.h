@@ -0,0 +1,23 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_ROUTER_H
+#define THINKING_IN_C_ROUTER_H
+
+#include <stddef.h>
+
+typedef enum {
+    ROUTE_NONE = -1,
+#define ROUTE(id, path) id,
+#define ROUTE_PREFIX(id, path) id,
+#include "routes.def"
+#undef ROUTE
+#undef ROUTE_PREFIX
+    ROUTE_COUNT
+} routeId;
+
+routeId routeLookup(const char*, size_t);
+const char* routePath(routeId);
+
+#endif //THINKING_IN_C_ROUTER_H
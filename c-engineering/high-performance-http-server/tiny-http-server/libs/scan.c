@@ -0,0 +1,111 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <string.h>
+#include "scan.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// every kernel returns the first byte in [p, end) that is one of "delims" (at most 16 of them), or "end".
+typedef const char* (*scanKernel)(const char*, const char*, const char*);
+
+static const char* scanScalar(const char* p, const char* end, const char* delims) {
+    if (delims[1] == '\0') {
+        const char* hit = memchr(p, delims[0], end - p);
+        return hit == NULL ? end : hit;
+    }
+    for (; p < end; p++)
+        for (const char* d = delims; *d != '\0'; d++)
+            if (*p == *d)
+                return p;
+    return end;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse4.2")))
+static const char* scanSSE42(const char* p, const char* end, const char* delims) {
+    // the set register must not be loaded straight from a literal shorter than 16 bytes.
+    char setBytes[16] = { 0 };
+    const int setLen = (int) strnlen(delims, sizeof(setBytes));
+    memcpy(setBytes, delims, setLen);
+    const __m128i set = _mm_loadu_si128((const __m128i*) setBytes);
+    for (; end - p >= 16; p += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i*) p);
+        const int idx = _mm_cmpestri(set, setLen, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return p + idx;
+    }
+    return scanScalar(p, end, delims);
+}
+
+__attribute__((target("avx2")))
+static const char* scanAVX2(const char* p, const char* end, const char* delims) {
+    __m256i sets[16];
+    int setLen = 0;
+    for (; setLen < 16 && delims[setLen] != '\0'; setLen++)
+        sets[setLen] = _mm256_set1_epi8(delims[setLen]);
+    for (; end - p >= 32; p += 32) {
+        const __m256i chunk = _mm256_loadu_si256((const __m256i*) p);
+        __m256i hits = _mm256_cmpeq_epi8(chunk, sets[0]);
+        for (int i = 1; i < setLen; i++)
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, sets[i]));
+        const unsigned mask = (unsigned) _mm256_movemask_epi8(hits);
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+    }
+    return scanScalar(p, end, delims);
+}
+#endif
+
+static struct {
+    const char* name;
+    scanKernel kernel;
+} scanImpl = { "scalar", scanScalar };
+
+static int cpuSupports(const char* name) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    if (strcmp(name, "sse4.2") == 0)
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+// picks a kernel by name ("avx2", "sse4.2" or "scalar"), returns -1 if the CPU lacks it.
+int scanSelect(const char* name) {
+    if (!cpuSupports(name))
+        return -1;
+#ifdef SCAN_X86
+    if (strcmp(name, "avx2") == 0) {
+        scanImpl.name = "avx2";
+        scanImpl.kernel = scanAVX2;
+        return 0;
+    }
+    if (strcmp(name, "sse4.2") == 0) {
+        scanImpl.name = "sse4.2";
+        scanImpl.kernel = scanSSE42;
+        return 0;
+    }
+#endif
+    scanImpl.name = "scalar";
+    scanImpl.kernel = scanScalar;
+    return 0;
+}
+
+// runtime dispatch, must run before the workers start.
+void scanInit(void) {
+    if (scanSelect("avx2") < 0 && scanSelect("sse4.2") < 0)
+        scanSelect("scalar");
+}
+
+const char* scanImplName(void) {
+    return scanImpl.name;
+}
+
+const char* scanDelims(const char* p, const char* end, const char* delims) {
+    return scanImpl.kernel(p, end, delims);
+}
@@ -0,0 +1,13 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_SCAN_H
+#define THINKING_IN_C_SCAN_H
+
+void scanInit(void);
+int scanSelect(const char*);
+const char* scanImplName(void);
+const char* scanDelims(const char*, const char*, const char*);
+
+#endif //THINKING_IN_C_SCAN_H
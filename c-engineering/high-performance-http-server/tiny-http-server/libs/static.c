@@ -0,0 +1,314 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// files under the static root are opened once and kept in a cache together with their
+// response head, so a hit costs a lookup, one write and a sendfile. an inotify watch on every
+// directory holding a cached file drops entries whose file changed, moved or disappeared.
+//
+#define _GNU_SOURCE
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+#include "static.h"
+
+static char rootPath[PATH_MAX];
+static int rootFd = -1;
+static int inotifyFd = -1;
+static pthread_rwlock_t cacheLock = PTHREAD_RWLOCK_INITIALIZER;
+static staticFile* cache[STATIC_CACHE_SLOTS];
+
+// directories being watched, "wd" is what inotify reports events with.
+static struct {
+    int wd;
+    char dir[STATIC_MAX_PATH];
+} watches[STATIC_MAX_DIRS];
+static int watchCount = 0;
+static atomic_ulong changes = 0;  // events seen, a file opened across one is not cached.
+
+static uint64_t fnv1a(const char* p, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) p[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// the slot holding "path", or the empty one where it would go, -1 if the table is full.
+static int findSlot(const char* path, size_t len) {
+    size_t slot = fnv1a(path, len) & (STATIC_CACHE_SLOTS - 1);
+    for (int probes = 0; probes < STATIC_CACHE_SLOTS; probes++, slot = (slot + 1) & (STATIC_CACHE_SLOTS - 1)) {
+        const staticFile* sf = cache[slot];
+        if (sf == NULL || (sf->pathLen == len && memcmp(sf->path, path, len) == 0))
+            return (int) slot;
+    }
+    return -1;
+}
+
+// empties "slot" keeping every probe chain intact, caller holds the write lock.
+static staticFile* unlinkSlot(int slot) {
+    staticFile* removed = cache[slot];
+    cache[slot] = NULL;
+    for (int next = (slot + 1) & (STATIC_CACHE_SLOTS - 1); cache[next] != NULL; next = (next + 1) & (STATIC_CACHE_SLOTS - 1)) {
+        staticFile* moved = cache[next];
+        cache[next] = NULL;
+        cache[findSlot(moved->path, moved->pathLen)] = moved;
+    }
+    return removed;
+}
+
+void staticRelease(staticFile* sf) {
+    if (atomic_fetch_sub(&sf->refs, 1) == 1) {
+        close(sf->fd);
+        free(sf);
+    }
+}
+
+static void invalidate(const char* path, size_t len) {
+    pthread_rwlock_wrlock(&cacheLock);
+    const int slot = findSlot(path, len);
+    staticFile* removed = slot >= 0 && cache[slot] != NULL ? unlinkSlot(slot) : NULL;
+    pthread_rwlock_unlock(&cacheLock);
+    if (removed != NULL)
+        staticRelease(removed);  // responses still sending it keep it open.
+}
+
+static void invalidateAll(void) {
+    pthread_rwlock_wrlock(&cacheLock);
+    for (int i = 0; i < STATIC_CACHE_SLOTS; i++) {
+        if (cache[i] != NULL) {
+            staticRelease(cache[i]);
+            cache[i] = NULL;
+        }
+    }
+    pthread_rwlock_unlock(&cacheLock);
+}
+
+// forgets a watch inotify dropped, so a recreated directory can take its place.
+static void unwatch(int wd) {
+    pthread_rwlock_wrlock(&cacheLock);
+    for (int i = 0; i < watchCount; i++)
+        if (watches[i].wd == wd) {
+            watches[i] = watches[--watchCount];
+            break;
+        }
+    pthread_rwlock_unlock(&cacheLock);
+}
+
+// drops the cached entry for every file inotify reports as changed, off the request path.
+static void* watchThread(void* arg) {
+    (void) arg;
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);  // signals belong to the main thread.
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        const ssize_t n = read(inotifyFd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return NULL;
+        }
+        for (const char* p = buf; p < buf + n;) {
+            const struct inotify_event* ev = (const struct inotify_event*) p;
+            p += sizeof(struct inotify_event) + ev->len;
+            atomic_fetch_add(&changes, 1);
+            if (ev->mask & IN_MOVE_SELF)
+                inotify_rm_watch(inotifyFd, ev->wd);  // its name is stale, IN_IGNORED follows.
+            if (ev->mask & IN_IGNORED)
+                unwatch(ev->wd);
+            if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                invalidateAll();  // events were lost, or a whole directory went away.
+                continue;
+            }
+            if (ev->len == 0)
+                continue;
+            char path[STATIC_MAX_PATH];
+            pthread_rwlock_rdlock(&cacheLock);
+            int len = -1;
+            for (int i = 0; i < watchCount; i++)
+                if (watches[i].wd == ev->wd)
+                    len = snprintf(path, sizeof(path), "%s%s", watches[i].dir, ev->name);
+            pthread_rwlock_unlock(&cacheLock);
+            if (len > 0 && (size_t) len < sizeof(path))
+                invalidate(path, len);
+        }
+    }
+}
+
+// the length of the directory part of "path" (relative, "a/b/c.css" -> "a/b/").
+static size_t dirLength(const char* path, size_t len) {
+    while (len > 0 && path[len - 1] != '/')
+        len--;
+    return len;
+}
+
+// whether the directory of "path" is watched already, caller holds the lock.
+static int dirWatched(const char* path, size_t len) {
+    const size_t dirLen = dirLength(path, len);
+    for (int i = 0; i < watchCount; i++)
+        if (strlen(watches[i].dir) == dirLen && memcmp(watches[i].dir, path, dirLen) == 0)
+            return 1;
+    return 0;
+}
+
+// watches the directory of "path", caller holds the write lock.
+static int watchDirOf(const char* path, size_t len) {
+    const size_t dirLen = dirLength(path, len);
+    char full[PATH_MAX];
+    if (snprintf(full, sizeof(full), "%s/%.*s", rootPath, (int) dirLen, path) >= (int) sizeof(full))
+        return -1;
+    const int wd = inotify_add_watch(inotifyFd, full, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM
+                                                      | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd < 0)
+        return -1;
+    for (int i = 0; i < watchCount; i++)
+        if (watches[i].wd == wd)
+            return 0;
+    if (watchCount == STATIC_MAX_DIRS) {
+        inotify_rm_watch(inotifyFd, wd);
+        return -1;
+    }
+    watches[watchCount].wd = wd;
+    memcpy(watches[watchCount].dir, path, dirLen);
+    watches[watchCount].dir[dirLen] = '\0';
+    watchCount++;
+    return 0;
+}
+
+int staticInit(const char* root) {
+    if (realpath(root, rootPath) == NULL || (rootFd = open(rootPath, O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return -1;
+    if ((inotifyFd = inotify_init1(IN_CLOEXEC)) < 0) {
+        close(rootFd);
+        rootFd = -1;
+        return -1;
+    }
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, watchThread, NULL);
+    return 0;
+}
+
+int staticEnabled(void) {
+    return rootFd >= 0;
+}
+
+// opens "path" without leaving the root, neither through ".." nor through symlinks where the kernel can tell.
+static int openBeneath(const char* path) {
+#ifdef SYS_openat2
+    struct open_how how = { .flags = O_RDONLY | O_CLOEXEC, .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS };
+    const int fd = (int) syscall(SYS_openat2, rootFd, path, &how, sizeof(how));
+    if (fd >= 0 || errno != ENOSYS)
+        return fd;
+#endif
+    return openat(rootFd, path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+}
+
+static const char* contentType(const char* path, size_t len) {
+    static const struct {
+        const char* ext;
+        const char* type;
+    } types[] = {
+        { ".html", "text/html; charset=utf-8" }, { ".css", "text/css" }, { ".js", "text/javascript" },
+        { ".json", "application/json" }, { ".txt", "text/plain; charset=utf-8" }, { ".svg", "image/svg+xml" },
+        { ".png", "image/png" }, { ".jpg", "image/jpeg" }, { ".ico", "image/x-icon" }, { ".wasm", "application/wasm" },
+    };
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        const size_t extLen = strlen(types[i].ext);
+        if (len > extLen && memcmp(path + len - extLen, types[i].ext, extLen) == 0)
+            return types[i].type;
+    }
+    return "application/octet-stream";
+}
+
+// no absolute paths, empty segments or "..", whatever openat2 would also refuse.
+static int validPath(const char* path, size_t len) {
+    if (len == 0 || len >= STATIC_MAX_PATH || path[0] == '/' || memmem(path, len, "//", 2) != NULL)
+        return 0;
+    for (const char* seg = path; seg < path + len;) {
+        const char* end = memchr(seg, '/', path + len - seg);
+        end = end == NULL ? path + len : end;
+        if (end - seg == 2 && seg[0] == '.' && seg[1] == '.')
+            return 0;
+        seg = end + 1;
+    }
+    return 1;
+}
+
+static staticFile* openFile(const char* path, size_t len) {
+    staticFile* sf = malloc(sizeof(staticFile));
+    if (sf == NULL)
+        return NULL;
+    memcpy(sf->path, path, len);
+    sf->path[len] = '\0';
+    sf->pathLen = len;
+    struct stat st;
+    if ((sf->fd = openBeneath(sf->path)) < 0 || fstat(sf->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (sf->fd >= 0)
+            close(sf->fd);
+        free(sf);
+        return NULL;
+    }
+    sf->size = st.st_size;
+    atomic_init(&sf->refs, 1);
+    struct tm tm;
+    strftime(sf->modified, sizeof(sf->modified), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&st.st_mtime, &tm));
+    sf->contentType = contentType(path, len);
+    sf->headerLen = snprintf(sf->header, sizeof(sf->header),
+                             "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %lld\r\nLast-Modified: %s\r\n\r\n",
+                             sf->contentType, (long long) st.st_size, sf->modified);
+    return sf;
+}
+
+// the file at "path" (relative to the root) with a reference for the caller, NULL if there is none.
+staticFile* staticAcquire(const char* path, size_t len) {
+    pthread_rwlock_rdlock(&cacheLock);
+    int slot = findSlot(path, len);
+    staticFile* sf = slot >= 0 ? cache[slot] : NULL;
+    if (sf != NULL)
+        atomic_fetch_add(&sf->refs, 1);
+    int watched = sf == NULL && dirWatched(path, len);
+    pthread_rwlock_unlock(&cacheLock);
+    if (sf != NULL)
+        return sf;
+
+    if (!validPath(path, len))
+        return NULL;
+    // the directory is watched before the file is opened, so a change right after the open
+    // is reported; one that lands while opening keeps the file out of the cache.
+    if (!watched) {
+        pthread_rwlock_wrlock(&cacheLock);
+        watched = watchDirOf(path, len) == 0;
+        pthread_rwlock_unlock(&cacheLock);
+    }
+    const unsigned long seen = atomic_load(&changes);
+    if ((sf = openFile(path, len)) == NULL)
+        return NULL;
+    pthread_rwlock_wrlock(&cacheLock);
+    slot = findSlot(path, len);
+    if (slot >= 0 && cache[slot] != NULL) {
+        // another worker cached it meanwhile.
+        staticRelease(sf);
+        sf = cache[slot];
+        atomic_fetch_add(&sf->refs, 1);
+    } else if (slot >= 0 && watched && atomic_load(&changes) == seen) {
+        cache[slot] = sf;
+        atomic_fetch_add(&sf->refs, 1);
+    }
+    // left uncached (table full, directory not watchable, changed while opening) the caller's
+    // reference is the only one.
+    pthread_rwlock_unlock(&cacheLock);
+    return sf;
+}
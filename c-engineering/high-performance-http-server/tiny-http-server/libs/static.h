@@ -0,0 +1,16 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_STATIC_H
+#define THINKING_IN_C_STATIC_H
+
+#include <stddef.h>
+#include "structs.h"
+
+int staticInit(const char*);
+int staticEnabled(void);
+staticFile* staticAcquire(const char*, size_t);
+void staticRelease(staticFile*);
+
+#endif //THINKING_IN_C_STATIC_H
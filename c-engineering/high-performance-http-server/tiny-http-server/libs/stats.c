@@ -0,0 +1,197 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <sys/mman.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include "stats.h"
+
+#define STATS_FIELD_COUNT (sizeof(statsCounters) / sizeof(unsigned long long))
+
+// one slot per worker process, living in memory shared with the supervisor.
+// the seqlock lets anyone read a consistent snapshot without ever blocking the writer,
+// the writer flag only serialises threads of the same process.
+typedef struct {
+    _Alignas(64) atomic_uint seq;
+    atomic_flag writer;
+    atomic_int pid;
+    atomic_ullong values[STATS_FIELD_COUNT];
+    // the autoscaler's last sample, a reading rather than a count so it is never summed.
+    // "scaleTarget" stays 0 until the first one, the ratios are in parts per million.
+    atomic_int scaleWorkers, scaleTarget;
+    atomic_uint scaleQueue, scaleUtilisation, scaleRunDelay;
+} statsSlot;
+
+typedef struct {
+    int slotCount;
+    atomic_ullong restarts;
+    statsSlot slots[];
+} statsRegion;
+
+static statsRegion* region = NULL;
+static int boundSlot = 0;
+static _Thread_local statsCounters pending;
+
+// must be called before forking so that all processes share the mapping.
+int statsInit(int slotCount) {
+    const size_t size = sizeof(statsRegion) + sizeof(statsSlot) * slotCount;
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return -1;
+    region = mem;  // the mapping comes zero-filled.
+    region->slotCount = slotCount;
+    for (int i = 0; i < slotCount; i++)
+        atomic_flag_clear(&region->slots[i].writer);
+    return 0;
+}
+
+// a worker that died inside "statsPublish" left the slot locked and its seq odd, which would
+// stall both its successor and every reader. nothing else writes the slot while it is being
+// rebound, so it is unlocked and the seq made even; the counts keep whatever it had written.
+void statsBindSlot(int slot) {
+    boundSlot = slot;
+    statsSlot* s = &region->slots[slot];
+    atomic_flag_clear(&s->writer);
+    const unsigned seq = atomic_load(&s->seq);
+    if (seq & 1)
+        atomic_store(&s->seq, seq + 1);
+    atomic_store(&s->pid, getpid());
+}
+
+statsCounters* statsLocal(void) {
+    return &pending;
+}
+
+// the writer side of the seqlock on this process's slot.
+static statsSlot* beginWrite(void) {
+    statsSlot* slot = &region->slots[boundSlot];
+    while (atomic_flag_test_and_set_explicit(&slot->writer, memory_order_acquire));
+    const unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return slot;
+}
+
+static void endWrite(statsSlot* slot) {
+    const unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+    atomic_flag_clear_explicit(&slot->writer, memory_order_release);
+}
+
+// folds what this thread counted since the last call into its process slot.
+void statsPublish(void) {
+    const unsigned long long* delta = (const unsigned long long*) &pending;
+    size_t i = 0;
+    while (i < STATS_FIELD_COUNT && delta[i] == 0)
+        i++;
+    if (region == NULL || i == STATS_FIELD_COUNT)
+        return;
+
+    statsSlot* slot = beginWrite();
+    for (i = 0; i < STATS_FIELD_COUNT; i++) {
+        const unsigned long long v = atomic_load_explicit(&slot->values[i], memory_order_relaxed);
+        atomic_store_explicit(&slot->values[i], v + delta[i], memory_order_relaxed);
+    }
+    endWrite(slot);
+    memset(&pending, 0, sizeof(pending));
+}
+
+// replaces the process's autoscaler sample.
+void statsPublishScale(const autoscaleSample* sample) {
+    if (region == NULL)
+        return;
+    statsSlot* slot = beginWrite();
+    atomic_store_explicit(&slot->scaleWorkers, sample->workers, memory_order_relaxed);
+    atomic_store_explicit(&slot->scaleTarget, sample->target, memory_order_relaxed);
+    atomic_store_explicit(&slot->scaleQueue, sample->queueLength, memory_order_relaxed);
+    atomic_store_explicit(&slot->scaleUtilisation, (unsigned) (sample->utilisation * 1e6), memory_order_relaxed);
+    atomic_store_explicit(&slot->scaleRunDelay, (unsigned) (sample->runDelay * 1e6), memory_order_relaxed);
+    endWrite(slot);
+}
+
+static int readSlot(int slotIndex, statsCounters* out, int* pid, autoscaleSample* scale) {
+    if (region == NULL || slotIndex < 0 || slotIndex >= region->slotCount)
+        return -1;
+    statsSlot* slot = &region->slots[slotIndex];
+    unsigned long long* values = (unsigned long long*) out;
+    unsigned before, after;
+    int tries = 0;
+    do {
+        if (tries++ == STATS_READ_RETRIES)
+            return -1;
+        if (tries > 1)
+            sched_yield();  // let a preempted writer finish.
+        before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        for (size_t i = 0; i < STATS_FIELD_COUNT; i++)
+            values[i] = atomic_load_explicit(&slot->values[i], memory_order_relaxed);
+        if (pid != NULL)
+            *pid = atomic_load_explicit(&slot->pid, memory_order_relaxed);
+        if (scale != NULL) {
+            scale->workers = atomic_load_explicit(&slot->scaleWorkers, memory_order_relaxed);
+            scale->target = atomic_load_explicit(&slot->scaleTarget, memory_order_relaxed);
+            scale->queueLength = atomic_load_explicit(&slot->scaleQueue, memory_order_relaxed);
+            scale->utilisation = atomic_load_explicit(&slot->scaleUtilisation, memory_order_relaxed) / 1e6;
+            scale->runDelay = atomic_load_explicit(&slot->scaleRunDelay, memory_order_relaxed) / 1e6;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return 0;
+}
+
+// -1 also when no consistent snapshot came up within STATS_READ_RETRIES tries, as with a
+// writer that died mid-update; "out" then holds the counts as they were last read.
+int statsRead(int slotIndex, statsCounters* out, int* pid) {
+    return readSlot(slotIndex, out, pid, NULL);
+}
+
+// the slot's last autoscaler sample, -1 when it has none or no consistent one came up.
+int statsReadScale(int slotIndex, autoscaleSample* out) {
+    statsCounters sc;
+    return readSlot(slotIndex, &sc, NULL, out) < 0 || out->target == 0 ? -1 : 0;
+}
+
+void statsTotal(statsCounters* total) {
+    memset(total, 0, sizeof(*total));
+    unsigned long long* sum = (unsigned long long*) total;
+    for (int i = 0; region != NULL && i < region->slotCount; i++) {
+        statsCounters sc;
+        statsRead(i, &sc, NULL);
+        for (size_t j = 0; j < STATS_FIELD_COUNT; j++)
+            sum[j] += ((unsigned long long*) &sc)[j];
+    }
+}
+
+void statsAddRestart(void) {
+    atomic_fetch_add(&region->restarts, 1);
+}
+
+static void printCounters(FILE* fp, const char* label, const statsCounters* sc) {
+    fprintf(fp, "%-12s accepted=%llu requests=%llu bytes_in=%llu bytes_out=%llu errors=%llu scale_ups=%llu scale_downs=%llu approximated=%llu\n",
+            label, sc->accepted, sc->requests, sc->bytesIn, sc->bytesOut, sc->errors, sc->scaleUps, sc->scaleDowns,
+            sc->approximated);
+}
+
+void statsDump(FILE* fp) {
+    if (region == NULL)
+        return;
+    char label[32];
+    for (int i = 0; i < region->slotCount; i++) {
+        statsCounters sc;
+        int pid;
+        const int torn = statsRead(i, &sc, &pid) < 0;
+        snprintf(label, sizeof(label), torn ? "[%d] pid %d?" : "[%d] pid %d", i, pid);
+        printCounters(fp, label, &sc);
+        autoscaleSample sample;
+        if (statsReadScale(i, &sample) == 0)
+            fprintf(fp, "%-12s workers=%d target=%d utilisation=%.2f queue=%u run_delay=%.2f\n", "  autoscale",
+                    sample.workers, sample.target, sample.utilisation, sample.queueLength, sample.runDelay);
+    }
+    statsCounters total;
+    statsTotal(&total);
+    printCounters(fp, "total", &total);
+    fprintf(fp, "restarts=%llu\n", atomic_load(&region->restarts));
+    fflush(fp);
+}
@@ -0,0 +1,22 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_STATS_H
+#define THINKING_IN_C_STATS_H
+
+#include <stdio.h>
+#include "structs.h"
+
+int statsInit(int);
+void statsBindSlot(int);
+statsCounters* statsLocal(void);
+void statsPublish(void);
+void statsPublishScale(const autoscaleSample*);
+int statsRead(int, statsCounters*, int*);
+int statsReadScale(int, autoscaleSample*);
+void statsTotal(statsCounters*);
+void statsAddRestart(void);
+void statsDump(FILE*);
+
+#endif //THINKING_IN_C_STATS_H
@@ -0,0 +1,159 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "store.h"
+
+// file layout: a fixed header followed by append-only records, each padded to 8 bytes.
+//   header: magic "FIBSTOR1", 56 reserved bytes.
+//   record: tag "FREC", digit count, n, FNV-1a sum of the digits, the digits, padding.
+// nothing is fsynced and several processes append, so a crash may leave a torn record anywhere
+// the page cache had not written back. the next open cuts the file at the first bad record.
+#define STORE_MAGIC "FIBSTOR1"
+#define STORE_HEADER_SIZE 64
+#define STORE_TAG 0x43455246u  // "FREC".
+
+typedef struct {
+    uint32_t tag;
+    uint32_t len;
+    int64_t n;
+    uint64_t sum;
+} storeRecord;
+
+typedef struct {
+    int64_t n;
+    uint64_t off;  // 0 marks an empty slot, records never start at 0.
+} storeSlot;
+
+static int storeFd = -1;
+static const char* mapped = NULL;
+static storeSlot* storeIndex = NULL;
+static size_t indexMask = 0;
+static size_t recordCount = 0;
+
+static uint64_t fnv1a(const char* p, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (len--)
+        h = (h ^ (unsigned char) *p++) * 0x100000001b3ULL;
+    return h;
+}
+
+static size_t recordSize(size_t len) {
+    return (sizeof(storeRecord) + len + 7) & ~(size_t) 7;
+}
+
+static storeSlot* slotOf(int64_t n) {
+    size_t i = ((uint64_t) n * 0x9e3779b97f4a7c15ULL) >> 20 & indexMask;
+    while (storeIndex[i].off != 0 && storeIndex[i].n != n)
+        i = (i + 1) & indexMask;
+    return &storeIndex[i];
+}
+
+// walks the records to rebuild the storeIndex, checking the digits of every one against its
+// sum, and sets "goodEnd" to the end of the last good record before the first bad one.
+// -1 when there is no memory for the index.
+static int buildIndex(size_t size, size_t* goodEnd) {
+    size_t count = 0;
+    for (size_t off = STORE_HEADER_SIZE; off + sizeof(storeRecord) <= size; count++) {
+        const storeRecord* rec = (const storeRecord*) (mapped + off);
+        if (rec->tag != STORE_TAG || off + recordSize(rec->len) > size)
+            break;
+        off += recordSize(rec->len);
+    }
+    size_t capacity = 64;
+    while (capacity < count * 2)
+        capacity <<= 1;
+    if ((storeIndex = calloc(capacity, sizeof(storeSlot))) == NULL)
+        return -1;
+    indexMask = capacity - 1;
+
+    size_t off = STORE_HEADER_SIZE;
+    for (size_t i = 0; i < count; i++) {
+        const storeRecord* rec = (const storeRecord*) (mapped + off);
+        if (fnv1a((const char*) (rec + 1), rec->len) != rec->sum)
+            break;
+        storeSlot* slot = slotOf(rec->n);
+        if (slot->off == 0) {
+            slot->n = rec->n;
+            slot->off = off;
+            recordCount++;
+        }
+        off += recordSize(rec->len);
+    }
+    *goodEnd = off;
+    return 0;
+}
+
+// maps an existing store and indexes it, or creates an empty one.
+int storeOpen(const char* path) {
+    if ((storeFd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0)
+        return -1;
+    struct stat st;
+    if (fstat(storeFd, &st) < 0)
+        goto fail;
+    if (st.st_size < STORE_HEADER_SIZE) {
+        char header[STORE_HEADER_SIZE] = STORE_MAGIC;
+        if (ftruncate(storeFd, 0) < 0 || write(storeFd, header, sizeof(header)) != sizeof(header))
+            goto fail;
+        st.st_size = STORE_HEADER_SIZE;
+    }
+    void* mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, storeFd, 0);
+    if (mem == MAP_FAILED)
+        goto fail;
+    mapped = mem;
+    if (memcmp(mapped, STORE_MAGIC, strlen(STORE_MAGIC)) != 0)
+        goto fail;
+    size_t goodEnd;
+    if (buildIndex(st.st_size, &goodEnd) < 0 || (goodEnd < (size_t) st.st_size && ftruncate(storeFd, goodEnd) < 0))
+        goto fail;
+    return 0;
+
+fail:
+    if (mapped != NULL)
+        munmap((void*) mapped, st.st_size);
+    mapped = NULL;
+    free(storeIndex);
+    storeIndex = NULL;
+    recordCount = 0;
+    close(storeFd);
+    storeFd = -1;
+    return -1;
+}
+
+size_t storeCount(void) {
+    return recordCount;
+}
+
+// values persisted by earlier runs, served straight from the mapping.
+const char* storeGet(long n, size_t* len) {
+    if (storeIndex == NULL)
+        return NULL;
+    const storeSlot* slot = slotOf(n);
+    if (slot->off == 0)
+        return NULL;
+    const storeRecord* rec = (const storeRecord*) (mapped + slot->off);
+    *len = rec->len;
+    return (const char*) (rec + 1);
+}
+
+// one writev on an O_APPEND descriptor, so records from several workers never interleave.
+// appended records are picked up by the next start, until then the memo serves them.
+int storePut(long n, const char* digits, size_t len) {
+    if (storeFd < 0)
+        return -1;
+    static const char padding[8] = { 0 };
+    storeRecord rec = { STORE_TAG, (uint32_t) len, n, fnv1a(digits, len) };
+    struct iovec iov[3] = {
+        { &rec, sizeof(rec) },
+        { (void*) digits, len },
+        { (void*) padding, recordSize(len) - sizeof(rec) - len }
+    };
+    return writev(storeFd, iov, 3) == (ssize_t) recordSize(len) ? 0 : -1;
+}
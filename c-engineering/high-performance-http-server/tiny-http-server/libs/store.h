@@ -0,0 +1,15 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_STORE_H
+#define THINKING_IN_C_STORE_H
+
+#include <stddef.h>
+
+int storeOpen(const char*);
+size_t storeCount(void);
+const char* storeGet(long, size_t*);
+int storePut(long, const char*, size_t);
+
+#endif //THINKING_IN_C_STORE_H
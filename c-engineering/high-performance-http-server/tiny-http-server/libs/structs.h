@@ -5,6 +5,11 @@
 #define THINKING_IN_C_STRUCT_H
 
 #include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "macros.h"
 
 // self-defined types.
 #include <sys/socket.h>
@@ -12,13 +17,218 @@
 // self-defined types.
 typedef struct sockaddr_in sockaddr_in;
 typedef struct sockaddr sockaddr;
+typedef struct sockaddr_un sockaddr_un;
 typedef struct {
     int threadCount;
+    int hugePages;
+    size_t maxHeaderBytes;
+    const char* simd;
+    int prefork;
+    int workerCount;
+    const char* memo;
+    const char* store;
+    long storeMinMicros;
+    const char* handoff;
+    int minThreads;
+    int maxThreads;
+    int scaleIntervalMs;
+    int cpus[MAX_PINNED_CPUS];
+    int cpuCount;
+    int mainCpu;
+    int numa;
+    int listenerShards;
+    int busyPollMicros;
+    long spinMicros;
+    int backlog;
+    int deferAcceptSeconds;
+    int fastOpenQueue;
+    int acceptBatch;
+    int epollExclusive;
+    const char* unixPath;
+    const char* plugin;
+    const char* staticRoot;
+    const char* capture;
+    int h2;
+    int h2MaxStreams;
+    int keepAliveRequests;
+    int batch;
+    long maxNum;
+    int computeThreads;
+    long degradeQueueMicros;
+    double degradeTolerance;
+    int writeTimeoutMs;
 } serverSettings;
 typedef struct {
     int serverFd;
-    sockaddr* addr;
-    socklen_t* addrLen;
+    const serverSettings* ss;
 } acceptParams;
+typedef struct {
+    unsigned long long accepted;
+    unsigned long long requests;
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+    unsigned long long errors;
+    unsigned long long scaleUps;
+    unsigned long long scaleDowns;
+    unsigned long long approximated;
+} statsCounters;
+typedef struct {
+    int workers;
+    int target;
+    unsigned queueLength;
+    double utilisation;
+    double runDelay;
+} autoscaleSample;
+typedef struct {
+    const char* ptr;
+    size_t len;
+} strSpan;
+typedef struct {
+    strSpan method;
+    strSpan target;
+    strSpan path;
+    strSpan query;
+    strSpan version;
+} httpRequestLine;
+// a segment lives at the head of a pooled buffer, its bytes follow it.
+typedef struct bufSeg {
+    struct bufSeg* next;
+    size_t poolCap;
+    size_t cap;
+    size_t len;
+    size_t start;  // bytes already consumed, only ever set in the head segment.
+    char data[];
+} bufSeg;
+typedef struct {
+    bufSeg* head;
+    bufSeg* tail;
+    size_t total;
+} bufChain;
+typedef struct {
+    bufSeg* seg;
+    size_t off;
+    size_t scanned;
+    size_t lineEnd;
+    size_t sinceNewline;
+    char lastByte;
+} httpHeadParser;
+// walks the header lines of a parsed head, see "headNextField".
+typedef struct {
+    const bufSeg* seg;
+    size_t off;
+    size_t left;  // head bytes not handed out yet.
+    char* scratch;  // holds a line that straddles segments.
+    size_t scratchCap;
+} httpHeadCursor;
+// an open file under the static root with its response head prepared.
+typedef struct {
+    char path[STATIC_MAX_PATH];  // relative to the root.
+    size_t pathLen;
+    int fd;
+    off_t size;
+    atomic_int refs;  // the cache holds one, every response in flight another.
+    const char* contentType;
+    char modified[32];
+    size_t headerLen;
+    char header[STATIC_HEADER_MAX];
+} staticFile;
+
+typedef struct h2Session h2Session;
+typedef struct connection {
+    int fd;
+    bufChain in;
+    httpHeadParser parser;
+    char* resBuf;
+    size_t resCap;
+    long acceptedAt;  // monotonic ns, only taken while a timing tracepoint is enabled.
+    h2Session* h2;  // set once the connection switched to HTTP/2.
+    int served;  // requests answered on it, more than one with keep-alive.
+    int batched;  // its request waits in the worker's micro-batch.
+    bufChain out;  // response bytes the socket did not take yet.
+    staticFile* file;  // a static file still to be sent after them.
+    off_t fileOff;
+    int blocked;  // output waits for the client, epoll watches for EPOLLOUT instead of EPOLLIN.
+    int closing;  // closed once its output is out.
+    long blockedAt;  // monotonic ns of the last progress while blocked.
+    int unsent;  // bytes its socket still held at the last look.
+    struct connection* prev;  // the open connections of one worker.
+    struct connection* next;
+} connection;
+// a request held back for the worker's next micro-batch, finished once it is computed.
+typedef struct {
+    connection* conn;
+    int num;
+    int keep;
+    size_t headLen;
+} batchSlot;
+// a piece of work for the compute pool.
+typedef struct {
+    void (*fn)(void*);
+    void* arg;
+} computeTask;
+
+// an HPACK dynamic table entry, the name and then the value follow it.
+typedef struct {
+    size_t nameLen;
+    size_t valueLen;
+    char data[];
+} hpackEntry;
+typedef struct {
+    hpackEntry* entries[HPACK_MAX_ENTRIES];  // a ring, the newest at "first".
+    int first;
+    int count;
+    size_t size;
+    size_t maxSize;
+    char* scratch;  // huffman-decoded strings of the block being decoded.
+    size_t scratchCap;
+} hpackDecoder;
+
+// an HTTP/2 stream still waiting for its request to end or for window to send its response.
+typedef struct {
+    uint32_t id;
+    int32_t sendWindow;
+    int requestDone;  // END_STREAM seen, the response may start.
+    int responded;  // HEADERS sent, what is left of the body waits for window.
+    char* method;  // ":method", then ":path", both copied until the request ends.
+    char* path;
+    size_t headerBytes;
+    char* body;  // response bytes left to send, owned by the stream.
+    size_t bodyLen;
+    size_t bodyOff;
+    staticFile* file;  // or a file to read them from.
+    off_t fileOff;
+} h2Stream;
+typedef void (*h2RequestFn)(h2Session*, uint32_t, const strSpan*, const strSpan*);
+struct h2Session {
+    int fd;
+    h2RequestFn onRequest;
+    int maxStreams;
+    size_t maxHeaderBytes;
+    int prefaceDone;
+    int settingsSeen;
+    int goingAway;
+    uint32_t lastStreamId;
+    // what the peer allows us.
+    int32_t sendWindow;
+    int32_t initialWindow;
+    uint32_t maxFrameSize;
+    size_t recvUnacked;  // connection-level DATA bytes not yet returned with a WINDOW_UPDATE.
+    // the header block being assembled from HEADERS and CONTINUATION frames.
+    uint32_t blockStream;
+    int blockEndStream;
+    unsigned char* block;
+    size_t blockLen;
+    size_t blockCap;
+    hpackDecoder decoder;
+    h2Stream* streams[H2_MAX_STREAMS];
+    int streamCount;
+    unsigned char* in;
+    size_t inLen;
+    unsigned char* out;
+    size_t outLen;
+    size_t outCap;
+    h2Session* prev;  // the sessions of one worker, told to go away when it drains.
+    h2Session* next;
+};
 
 #endif //THINKING_IN_C_STRUCT_H
\ No newline at end of file
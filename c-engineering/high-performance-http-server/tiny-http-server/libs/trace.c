@@ -0,0 +1,14 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+#include "trace.h"
+
+#ifdef USDT
+// tracers find the semaphores through the probe notes and bump them while attached.
+#define TRACE_DEFINE(name) unsigned short TRACE_SEMAPHORE(name) __attribute__((section(".probes"), used))
+TRACE_DEFINE(accept);
+TRACE_DEFINE(parse_done);
+TRACE_DEFINE(compute_start);
+TRACE_DEFINE(compute_end);
+TRACE_DEFINE(write_done);
+#endif
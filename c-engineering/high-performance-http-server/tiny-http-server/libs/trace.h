@@ -0,0 +1,50 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+
+#ifndef THINKING_IN_C_TRACE_H
+#define THINKING_IN_C_TRACE_H
+
+#include <time.h>
+
+// USDT probes of provider "tiny_http", for perf and bpftrace:
+//   accept(fd)
+//   parse_done(fd, head bytes, ns since accept)
+//   compute_start(fd, num)
+//   compute_end(fd, num, digit count, ns computing)
+//   write_done(fd, response bytes, ns since accept)
+// each probe is a nop until a tracer attaches. without <sys/sdt.h> (systemtap-sdt-dev), or
+// built with -DNO_USDT, they compile to nothing at all.
+#if !defined(NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define USDT 1
+#endif
+#endif
+
+#ifdef USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+// a probe's semaphore counts the tracers attached to it, timing work is skipped while it is 0.
+#define TRACE_SEMAPHORE(name) tiny_http_##name##_semaphore
+#define TRACE_ENABLED(name) __builtin_expect(TRACE_SEMAPHORE(name) != 0, 0)
+#define TRACE1(name, a) DTRACE_PROBE1(tiny_http, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(tiny_http, name, a, b)
+#define TRACE3(name, a, b, c) DTRACE_PROBE3(tiny_http, name, a, b, c)
+#define TRACE4(name, a, b, c, d) DTRACE_PROBE4(tiny_http, name, a, b, c, d)
+extern unsigned short TRACE_SEMAPHORE(accept), TRACE_SEMAPHORE(parse_done), TRACE_SEMAPHORE(compute_start),
+                      TRACE_SEMAPHORE(compute_end), TRACE_SEMAPHORE(write_done);
+#else
+#define TRACE_ENABLED(name) 0
+#define TRACE1(name, a) ((void) (a))
+#define TRACE2(name, a, b) ((void) (a), (void) (b))
+#define TRACE3(name, a, b, c) ((void) (a), (void) (b), (void) (c))
+#define TRACE4(name, a, b, c, d) ((void) (a), (void) (b), (void) (c), (void) (d))
+#endif
+
+static inline long traceNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+#endif //THINKING_IN_C_TRACE_H
@@ -0,0 +1,49 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// a compute plugin with iterative 64-bit kernels: F(n) exact up to F(93), and F(n) mod m for
+// n below FIBMOD_ITERATIVE_MAX.
+// build it as a shared object and start the server with "plugin=<path>".
+//
+#include <stdint.h>
+#include <stdio.h>
+#include "libs/plugin.h"
+
+#define FIBMOD_ITERATIVE_MAX 65536
+
+static long fibDigits(long n, char* buf, size_t cap) {
+    if (n < 0 || n > 93)
+        return -1;
+    uint64_t a = 0, b = 1;
+    for (long i = 0; i < n; i++) {
+        const uint64_t next = a + b;
+        a = b;
+        b = next;
+    }
+    return snprintf(buf, cap, "%llu", (unsigned long long) a);
+}
+
+static int fibMod(uint64_t n, uint64_t m, uint64_t* residue) {
+    if (n >= FIBMOD_ITERATIVE_MAX)
+        return -1;
+    uint64_t a = 0, b = 1 % m;
+    for (uint64_t i = 0; i < n; i++) {
+        const uint64_t next = a >= m - b ? a - (m - b) : a + b;  // (a + b) mod m without overflow.
+        a = b;
+        b = next;
+    }
+    *residue = a;
+    return 0;
+}
+
+static const computePlugin plugin = {
+    .abiVersion = PLUGIN_ABI_VERSION,
+    .size = sizeof(computePlugin),
+    .name = "fib-iterative",
+    .fibDigits = fibDigits,
+    .fibMod = fibMod,
+};
+
+const computePlugin* computePluginEntry(void) {
+    return &plugin;
+}
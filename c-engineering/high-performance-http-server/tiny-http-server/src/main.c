@@ -1,8 +1,17 @@
 //
 // Created by fufeng on 2024/2/2.
 //
+#define _GNU_SOURCE
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <unistd.h>
@@ -11,104 +20,1297 @@
 #include <stdio.h>
 #include <stdnoreturn.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "libs/affinity.h"
+#include "libs/autoscale.h"
+#include "libs/batch.h"
+#include "libs/capture.h"
+#include "libs/chain.h"
+#include "libs/degrade.h"
+#include "libs/engine.h"
+#include "libs/h2.h"
+#include "libs/handoff.h"
 #include "libs/helpers.h"
+#include "libs/http.h"
+#include "libs/memo.h"
+#include "libs/plugin.h"
+#include "libs/pool.h"
+#include "libs/router.h"
+#include "libs/scan.h"
+#include "libs/static.h"
+#include "libs/stats.h"
+#include "libs/store.h"
 #include "libs/structs.h"
+#include "libs/trace.h"
 #include "libs/macros.h"
 
 // global variables.
 atomic_int threadCounter = 0;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+atomic_int draining = 0;  // set once the listening socket has been handed to a successor.
+int wakeFd = -1;
+static char wakeTag;  // marks the wake-up eventfd in the workers' epoll sets.
+static char shardTag;  // marks a worker's own listener shard.
+static _Thread_local int openConns = 0;
+static _Thread_local connection* liveConns = NULL;  // so idle keep-alive ones can be closed on drain.
+static _Thread_local int blockedConns = 0;  // those waiting for their client to take its output.
+static _Thread_local long sweptAt = 0;  // when "dropStalled" last looked at them.
+static _Thread_local int shardFd = -1;
+static _Thread_local long acceptPausedUntil = 0;  // while out of descriptors, the listeners sit out until then.
+static atomic_flag acceptWarned = ATOMIC_FLAG_INIT;
+static int processSlot = 0;  // which prefork worker this process is.
 
 void renewThread(void *arg) {
-    int* acceptedSocket = (int*) arg;
-    close(*acceptedSocket);
+    int* epollFd = (int*) arg;
+    close(*epollFd);
+    if (shardFd >= 0) {
+        close(shardFd);
+        shardFd = -1;
+    }
+    autoscaleUnregister();
+    poolThreadFlush();  // hand cached objects back to the shared pools.
     pthread_mutex_lock(&mutex);
     threadCounter--;
     pthread_cond_signal(&cond);  // notify main thread.
     pthread_mutex_unlock(&mutex);
 }
 
+static long elapsedNanos(const struct timespec* from) {
+    struct timespec to;
+    clock_gettime(CLOCK_MONOTONIC, &to);
+    return (to.tv_sec - from->tv_sec) * 1000000000L + (to.tv_nsec - from->tv_nsec);
+}
+
+static long nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int outputPending(const connection* conn) {
+    return conn->h2 != NULL ? h2Pending(conn->h2) : conn->out.total > 0 || conn->file != NULL;
+}
+
+// epoll reports "conn" writable while output waits on it, and readable otherwise: what the
+// client pipelined meanwhile is only read once it took its answers.
+static void watchConn(int epollFd, connection* conn) {
+    const int blocked = outputPending(conn);
+    if (blocked == conn->blocked)
+        return;
+    struct epoll_event ev = { .events = blocked ? EPOLLOUT : EPOLLIN, .data.ptr = conn };
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->blocked = blocked;
+    conn->blockedAt = nowNanos();
+    conn->unsent = -1;
+    blockedConns += blocked ? 1 : -1;
+}
+
+static void closeConn(int epollFd, connection* conn) {
+    statsLocal()->bytesIn += conn->in.total;
+    if (conn->blocked)
+        blockedConns--;
+    if (conn->file != NULL)
+        staticRelease(conn->file);
+    if (conn->h2 != NULL) {
+        h2Close(conn->h2);
+        conn->h2 = NULL;
+    }
+    openConns--;
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        liveConns = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    connRelease(conn);
+}
+
+// closes "conn" once its client has taken what it was sent.
+static void finishConn(int epollFd, connection* conn) {
+    if (!outputPending(conn)) {
+        closeConn(epollFd, conn);
+        return;
+    }
+    conn->closing = 1;
+    watchConn(epollFd, conn);
+}
+
+// a broken connection keeps nothing to send and is closed.
+static void dropOutput(connection* conn) {
+    chainRelease(&conn->out);
+    if (conn->file != NULL) {
+        staticRelease(conn->file);
+        conn->file = NULL;
+    }
+    conn->closing = 1;
+}
+
+// sends what waits on "conn", its file last. returns 1 once all of it is out, 0 when the
+// socket is full again, -1 when the client is gone.
+static int flushOut(connection* conn) {
+    while (conn->out.total > 0) {
+        struct iovec iov[WRITE_IOVS];
+        int count = 0;
+        for (bufSeg* seg = conn->out.head; seg != NULL && count < WRITE_IOVS; seg = seg->next)
+            iov[count++] = (struct iovec) { seg->data + seg->start, seg->len - seg->start };
+        const ssize_t n = writev(conn->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        chainConsume(&conn->out, n);
+    }
+    // zero-copy from the page cache, the shared fd is read at explicit offsets.
+    while (conn->file != NULL) {
+        staticFile* sf = conn->file;
+        const ssize_t n = sendfile(conn->fd, sf->fd, &conn->fileOff, sf->size - conn->fileOff);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (n <= 0)
+            return -1;  // the file shrank under us or the peer went away.
+        statsLocal()->bytesOut += n;
+        if (conn->fileOff >= sf->size) {
+            staticRelease(sf);
+            conn->file = NULL;
+        }
+    }
+    return 1;
+}
+
+// hands a response to the socket. what it does not take at once waits on the connection
+// until epoll reports it writable, so a client that does not read never holds up the worker.
+static void respondv(connection* conn, const struct iovec* iov, int count) {
+    size_t sent = 0;
+    for (int i = 0; i < count; i++)
+        statsLocal()->bytesOut += iov[i].iov_len;
+    if (!outputPending(conn)) {
+        ssize_t n;
+        while ((n = writev(conn->fd, iov, count)) < 0 && errno == EINTR);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            dropOutput(conn);
+            return;
+        }
+        sent = n > 0 ? n : 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (sent >= iov[i].iov_len) {
+            sent -= iov[i].iov_len;
+            continue;
+        }
+        if (chainAppend(&conn->out, (const char*) iov[i].iov_base + sent, iov[i].iov_len - sent) < 0) {
+            dropOutput(conn);
+            return;
+        }
+        sent = 0;
+    }
+}
+
+static void respond(connection* conn, const char* res, size_t len) {
+    const struct iovec iov = { (char*) res, len };
+    respondv(conn, &iov, 1);
+}
+
+// the "num" parameter of "target". the query parsers keep no state, so workers parse side by side.
+static int queryNum(const strSpan* target) {
+    return retrieveQueryIntValByKey(target->ptr, target->len, "num");
+}
+
+// the digits of F(num), the same engine behind HTTP/1.1 and HTTP/2. "error" is the relative
+// error bound of an estimate, -1 for an exact value.
+static const char* fibDigits(int fd, int num, char* computed, size_t cap, size_t* digitsLen, double* error) {
+    TRACE2(compute_start, fd, num);
+    const long computeFrom = TRACE_ENABLED(compute_end) ? traceNanos() : 0;
+    const char* digits = engineFibDigits(num, computed, cap, digitsLen, error);
+    TRACE4(compute_end, fd, num, digits != NULL ? *digitsLen : 0, computeFrom != 0 ? traceNanos() - computeFrom : 0);
+    if (digits != NULL && *error >= 0)
+        statsLocal()->approximated++;
+    return digits;
+}
+
+// "headers" are extra header lines, each ending in CRLF, or NULL.
+static void respondDigits(connection* conn, const char* digits, size_t digitsLen, const char* headers) {
+    // follow the format of the http response.
+    const int headLen = snprintf(conn->resBuf, conn->resCap, "HTTP/1.1 200 OK\r\n%sContent-Length: %zu\r\n\r\n",
+                                 headers != NULL ? headers : "", digitsLen);
+    if ((size_t) headLen + digitsLen <= conn->resCap) {
+        memcpy(conn->resBuf + headLen, digits, digitsLen);
+        respond(conn, conn->resBuf, headLen + digitsLen);
+    } else {
+        // a big F(n) goes out straight from where it is, in one writev with its head.
+        const struct iovec iov[2] = { { conn->resBuf, headLen }, { (char*) digits, digitsLen } };
+        respondv(conn, iov, 2);
+    }
+}
+
+static void respondBadRequest(connection* conn) {
+    static const char badRequest[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+    respond(conn, badRequest, sizeof(badRequest) - 1);
+    statsLocal()->errors++;
+}
+
+static void respondFib(connection* conn, int num) {
+    size_t digitsLen;
+    double error;
+    char computed[32];  // F(93), the largest 64-bit value, has 20 digits. bigger ones are not copied here.
+    const char* digits = fibDigits(conn->fd, num, computed, sizeof(computed), &digitsLen, &error);
+    if (digits == NULL) {
+        respondBadRequest(conn);
+        return;
+    }
+    // an estimate says so, with the bound of its relative error.
+    char approximate[48];
+    if (error >= 0)
+        snprintf(approximate, sizeof(approximate), "X-Fib-Approximate: %.1e\r\n", error);
+    respondDigits(conn, digits, digitsLen, error >= 0 ? approximate : NULL);
+}
+
+// the digits of F(n) mod m for the "n" and "m" parameters of "target", 0 when either is
+// missing or m is 0.
+static size_t fibModForTarget(const strSpan* target, char* digits, size_t cap) {
+    uint64_t n, m, residue;
+    const int parsed = retrieveQueryU64ValByKey(target->ptr, target->len, "n", &n) == 0
+                       && retrieveQueryU64ValByKey(target->ptr, target->len, "m", &m) == 0;
+    if (!parsed || engineFibMod(n, m, &residue) < 0)
+        return 0;
+    return snprintf(digits, cap, "%llu", (unsigned long long) residue);
+}
+
+// the counters as text, NULL if there is no memory for them. the caller frees it.
+static char* statsText(size_t* len) {
+    statsPublish();  // include this worker's latest counts.
+    char* body = NULL;
+    FILE* fp = open_memstream(&body, len);
+    if (fp == NULL)
+        return NULL;
+    statsDump(fp);
+    fclose(fp);
+    return body;
+}
+
+static void respondStats(connection* conn) {
+    size_t bodyLen;
+    char* body = statsText(&bodyLen);
+    if (body == NULL) {
+        static const char unavailable[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+        respond(conn, unavailable, sizeof(unavailable) - 1);
+        return;
+    }
+    const int headLen = snprintf(conn->resBuf, conn->resCap,
+                                 "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n\r\n", bodyLen);
+    const struct iovec iov[2] = { { conn->resBuf, headLen }, { body, bodyLen } };
+    respondv(conn, iov, 2);
+    free(body);
+}
+
+// the head goes out with MSG_MORE so it shares a segment with the start of the file.
+static void respondFile(connection* conn, const strSpan* method, const strSpan* path) {
+    static const char prefix[] = "/static/";
+    staticFile* sf = staticAcquire(path->ptr + sizeof(prefix) - 1, path->len - (sizeof(prefix) - 1));
+    if (sf == NULL) {
+        static const char notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        respond(conn, notFound, sizeof(notFound) - 1);
+        statsLocal()->errors++;
+        return;
+    }
+    ssize_t sent = outputPending(conn) ? 0 : send(conn->fd, sf->header, sf->headerLen, MSG_MORE | MSG_NOSIGNAL);
+    sent = sent > 0 ? sent : 0;
+    statsLocal()->bytesOut += sent;
+    if ((size_t) sent < sf->headerLen)
+        respond(conn, sf->header + sent, sf->headerLen - sent);  // only on a full socket buffer, which is rare for a head.
+    const int headOnly = method->len == 4 && memcmp(method->ptr, "HEAD", 4) == 0;
+    if (headOnly || sf->size == 0 || conn->closing) {
+        staticRelease(sf);
+        return;
+    }
+    // the body follows whatever of the head still waits, as far as the socket takes it now.
+    conn->file = sf;
+    conn->fileOff = 0;
+    if (flushOut(conn) < 0)
+        dropOutput(conn);
+}
+
+// serves one HTTP/2 request, "target" is its ":path" with the query.
+static void handleStream(h2Session* s, uint32_t id, const strSpan* method, const strSpan* target) {
+    const char* query = memchr(target->ptr, '?', target->len);
+    const strSpan path = { target->ptr, query != NULL ? (size_t) (query - target->ptr) : target->len };
+    statsLocal()->requests++;
+
+    switch (routeLookup(path.ptr, path.len)) {
+        case ROUTE_ROOT:
+        case ROUTE_FIB: {
+            size_t digitsLen;
+            double error;
+            char computed[32], approximate[16];
+            const char* digits = fibDigits(s->fd, queryNum(target), computed, sizeof(computed), &digitsLen, &error);
+            if (digits != NULL && error >= 0) {
+                snprintf(approximate, sizeof(approximate), "%.1e", error);
+                h2RespondHeader(s, id, 200, "text/plain", "x-fib-approximate", approximate, digits, digitsLen);
+            } else if (digits != NULL) {
+                h2Respond(s, id, 200, "text/plain", digits, digitsLen);
+            } else {
+                h2Respond(s, id, 400, NULL, NULL, 0);
+                statsLocal()->errors++;
+            }
+            break;
+        }
+        case ROUTE_FIBMOD: {
+            char digits[32];
+            const size_t digitsLen = fibModForTarget(target, digits, sizeof(digits));
+            h2Respond(s, id, digitsLen > 0 ? 200 : 400, digitsLen > 0 ? "text/plain" : NULL, digits, digitsLen);
+            if (digitsLen == 0)
+                statsLocal()->errors++;
+            break;
+        }
+        case ROUTE_HEALTH:
+            h2Respond(s, id, 200, NULL, "ok", 2);
+            break;
+        case ROUTE_STATS: {
+            size_t bodyLen;
+            char* body = statsText(&bodyLen);
+            h2Respond(s, id, body != NULL ? 200 : 503, "text/plain", body, body != NULL ? bodyLen : 0);
+            free(body);
+            break;
+        }
+        case ROUTE_STATIC: {
+            static const char prefix[] = "/static/";
+            staticFile* sf = staticEnabled() ? staticAcquire(path.ptr + sizeof(prefix) - 1, path.len - (sizeof(prefix) - 1)) : NULL;
+            if (sf != NULL) {
+                h2RespondFile(s, id, sf, method->len == 4 && memcmp(method->ptr, "HEAD", 4) == 0);
+                break;
+            }
+        }
+            // fall through.
+        default:
+            h2Respond(s, id, 404, NULL, NULL, 0);
+            statsLocal()->errors++;
+    }
+}
+
+// whether the comma-separated "value" lists "token", ignoring case.
+static int hasToken(const strSpan* value, const char* token, size_t len) {
+    for (const char* p = value->ptr; p + len <= value->ptr + value->len; p++)
+        if (strncasecmp(p, token, len) == 0 && (p == value->ptr || p[-1] == ',' || p[-1] == ' ')
+            && (p + len == value->ptr + value->len || p[len] == ',' || p[len] == ' '))
+            return 1;
+    return 0;
+}
+
+// one pass over the header lines for what decides the connection's fate (HEAD_* flags), the
+// "HTTP2-Settings" of an upgrade request are copied to "settings" (its "cap" bytes at most).
+static int scanHeaders(httpHeadCursor* hc, char* settingsBuf, size_t cap, strSpan* settings) {
+    int flags = 0;
+    strSpan name, value;
+    settings->ptr = NULL;
+    while (headNextField(hc, &name, &value)) {
+        if (name.len == 10 && strncasecmp(name.ptr, "connection", 10) == 0) {
+            if (hasToken(&value, "keep-alive", 10))
+                flags |= HEAD_KEEP_ALIVE;
+            if (hasToken(&value, "close", 5))
+                flags |= HEAD_CLOSE;
+        } else if (name.len == 7 && strncasecmp(name.ptr, "upgrade", 7) == 0) {
+            if (memmem(value.ptr, value.len, "h2c", 3) != NULL)
+                flags |= HEAD_UPGRADE_H2C;
+        } else if (name.len == 14 && strncasecmp(name.ptr, "http2-settings", 14) == 0 && value.len <= cap) {
+            // the line may sit in the cursor's scratch, which the next one reuses.
+            memcpy(settingsBuf, value.ptr, value.len);
+            *settings = (strSpan) { settingsBuf, value.len };
+        } else if ((name.len == 14 && strncasecmp(name.ptr, "content-length", 14) == 0
+                    && !(value.len == 1 && value.ptr[0] == '0'))
+                   || (name.len == 17 && strncasecmp(name.ptr, "transfer-encoding", 17) == 0)) {
+            flags |= HEAD_BODY;  // never read, so nothing after it can be trusted as the next request.
+        }
+    }
+    if (settings->ptr == NULL)
+        flags &= ~HEAD_UPGRADE_H2C;
+    return flags;
+}
+
+// a client with prior knowledge opens with the HTTP/2 preface, whose first line parses as
+// "PRI * HTTP/2.0"; others may ask to upgrade. returns -1 when the connection stays HTTP/1.1,
+// otherwise whether it stays open as HTTP/2.
+static int switchToH2(connection* conn, const httpRequestLine* rl, int flags, const strSpan* settings,
+                      const serverSettings* ss) {
+    const int preface = rl->method.len == 3 && memcmp(rl->method.ptr, "PRI", 3) == 0
+                        && rl->target.len == 1 && rl->target.ptr[0] == '*';
+    // a body would have to be read before the session's preface, such an upgrade is declined.
+    if (!preface && (!(flags & HEAD_UPGRADE_H2C) || (flags & HEAD_BODY)))
+        return -1;
+    h2Session* s = h2Open(conn->fd, ss, handleStream);
+    if (s == NULL)
+        return preface ? 0 : -1;
+    if (!preface) {
+        if (h2Upgrade(s, settings->ptr, settings->len) < 0) {
+            h2Close(s);
+            return -1;  // a server may decline an upgrade, and a malformed one is best declined.
+        }
+        static const char switching[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+        respond(conn, switching, sizeof(switching) - 1);
+    }
+    conn->h2 = s;
+    if (!preface && h2UpgradeRequest(s, &rl->method, &rl->target) < 0)
+        return 0;
+    // the rest of what was read belongs to the session: the whole preface, or what followed the upgrade.
+    size_t skip = preface ? 0 : conn->parser.scanned;
+    for (const bufSeg* seg = conn->in.head; seg != NULL; seg = seg->next) {
+        const size_t len = seg->len - seg->start;
+        if (skip >= len) {
+            skip -= len;
+            continue;
+        }
+        if (h2Input(s, seg->data + seg->start + skip, len - skip) < 0)
+            return 0;
+        skip = 0;
+    }
+    return 1;
+}
+
+// HTTP/1.1 keeps a connection open unless the client says "Connection: close", HTTP/1.0
+// only when it asks for "keep-alive". returns "flags" with HEAD_KEEP_ALIVE set accordingly.
+static int persistence(const httpRequestLine* rl, int flags) {
+    const int http11 = rl->version.len == 8 && memcmp(rl->version.ptr, "HTTP/1.1", 8) == 0;
+    if (flags & HEAD_CLOSE)
+        return flags & ~HEAD_KEEP_ALIVE;
+    return http11 ? flags | HEAD_KEEP_ALIVE : flags;
+}
+
+// the worker's micro-batch: small fibonacci requests wait here until it is full or the
+// wakeup that collected them ends, then one kernel call answers them all.
+static _Thread_local batchSlot batchSlots[BATCH_MAX];
+static _Thread_local int batchCount = 0;
+
+// whether the connection stays open for another request after this one. keep-alive is the
+// client's choice (see "persistence"), a request with a body closes since the body is not read.
+static int keepsAlive(connection* conn, int flags, const serverSettings* ss) {
+    return (flags & (HEAD_KEEP_ALIVE | HEAD_BODY)) == HEAD_KEEP_ALIVE && ++conn->served < ss->keepAliveRequests;
+}
+
+// drops the answered head, a pipelined request behind it moves up.
+static void nextRequest(connection* conn, size_t headLen) {
+    statsLocal()->bytesIn += headLen;
+    chainConsume(&conn->in, headLen);
+    headParserInit(&conn->parser, &conn->in);
+}
+
+// answers a request whose head has fully arrived, returns 1 if the connection stays open
+// (keep-alive, switched to HTTP/2, or waiting in the micro-batch), 0 when it is done.
+static int handleRequest(connection* conn, const serverSettings* ss) {
+    const unsigned long long bytesBefore = statsLocal()->bytesOut;
+    TRACE3(parse_done, conn->fd, conn->parser.scanned, conn->acceptedAt != 0 ? traceNanos() - conn->acceptedAt : 0);
+    const size_t headLen = conn->parser.scanned;
+    size_t lineLen;
+    char* line = headRequestLine(&conn->parser, &conn->in, &lineLen);
+    if (line == NULL) {
+        static const char uriTooLong[] = "HTTP/1.1 414 URI Too Long\r\n\r\n";
+        respond(conn, uriTooLong, sizeof(uriTooLong) - 1);
+        statsLocal()->errors++;
+        return 0;
+    }
+    httpRequestLine rl;
+    char settingsBuf[H2_SETTINGS_MAX];
+    strSpan settings = { NULL, 0 };
+    const int parsed = httpParseRequestLine(line, lineLen, &rl) == 0;
+    int flags = 0;
+    if (parsed) {
+        // the header lines are read where they lie, whichever segments the head spans.
+        httpHeadCursor hc;
+        headCursorInit(&hc, &conn->parser, &conn->in);
+        flags = persistence(&rl, scanHeaders(&hc, settingsBuf, sizeof(settingsBuf), &settings));
+        headCursorRelease(&hc);
+    }
+    const int h2 = parsed && ss->h2 ? switchToH2(conn, &rl, flags, &settings, ss) : -1;
+    if (h2 >= 0) {
+        // the session keeps its own buffers from here on.
+        headReleaseLine(&conn->in, line, lineLen);
+        statsLocal()->bytesIn += conn->in.total;
+        chainRelease(&conn->in);
+        return h2;
+    }
+    captureRequest(&conn->in, headLen);
+    const routeId route = parsed ? routeLookup(rl.path.ptr, rl.path.len) : ROUTE_NONE;
+    statsLocal()->requests++;
+
+    switch (route) {
+        case ROUTE_ROOT:
+        case ROUTE_FIB: {
+            const int num = queryNum(&rl.target);
+            if (batchCount < ss->batch && engineBatchable(num)) {
+                // answered by "flushBatch", the head stays in the chain until then.
+                TRACE2(compute_start, conn->fd, num);
+                headReleaseLine(&conn->in, line, lineLen);
+                batchSlots[batchCount++] = (batchSlot) { conn, num, keepsAlive(conn, flags, ss), headLen };
+                conn->batched = 1;
+                return 1;
+            }
+            respondFib(conn, num);
+            break;
+        }
+        case ROUTE_FIBMOD: {
+            char digits[32];
+            const size_t digitsLen = fibModForTarget(&rl.target, digits, sizeof(digits));
+            if (digitsLen > 0)
+                respondDigits(conn, digits, digitsLen, NULL);
+            else
+                respondBadRequest(conn);
+            break;
+        }
+        case ROUTE_HEALTH: {
+            static const char healthy[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+            respond(conn, healthy, sizeof(healthy) - 1);
+            break;
+        }
+        case ROUTE_STATS:
+            respondStats(conn);
+            break;
+        case ROUTE_STATIC:
+            if (staticEnabled()) {
+                respondFile(conn, &rl.method, &rl.path);
+                break;
+            }
+            // fall through.
+        default: {
+            static const char notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+            respond(conn, notFound, sizeof(notFound) - 1);
+            statsLocal()->errors++;
+        }
+    }
+    headReleaseLine(&conn->in, line, lineLen);
+    TRACE3(write_done, conn->fd, statsLocal()->bytesOut - bytesBefore,
+           conn->acceptedAt != 0 ? traceNanos() - conn->acceptedAt : 0);
+    if (!keepsAlive(conn, flags, ss))
+        return 0;
+    nextRequest(conn, headLen);
+    return 1;
+}
+
+// answers the complete requests already read on "conn" in order, stopping at one that waits
+// in the micro-batch or once an answer waits for the client. returns 0 once the connection
+// should be closed.
+static int serveBuffered(connection* conn, const serverSettings* ss, int listening, int* handled) {
+    int open = 1;
+    while (open && conn->h2 == NULL && !conn->batched && !outputPending(conn) && headParse(&conn->parser, &conn->in)) {
+        open = handleRequest(conn, ss) && (listening || conn->batched);
+        (*handled)++;
+    }
+    return open && !conn->closing;
+}
+
+// computes the micro-batch in one kernel call and finishes its requests. a keep-alive
+// connection goes on with what it pipelined, which may fill the next batch.
+static void flushBatch(int epollFd, const serverSettings* ss, int listening) {
+    while (batchCount > 0) {
+        batchSlot slots[BATCH_MAX];
+        int nums[BATCH_MAX];
+        char digits[BATCH_MAX][BATCH_DIGITS];
+        size_t lens[BATCH_MAX];
+        const int count = batchCount;
+        memcpy(slots, batchSlots, sizeof(batchSlot) * count);
+        for (int i = 0; i < count; i++)
+            nums[i] = slots[i].num;
+        batchCount = 0;
+
+        const long computeFrom = TRACE_ENABLED(compute_end) ? traceNanos() : 0;
+        engineFibBatch(nums, count, digits, lens);
+        const long computeNanos = computeFrom != 0 ? traceNanos() - computeFrom : 0;
+        for (int i = 0; i < count; i++) {
+            connection* conn = slots[i].conn;
+            const unsigned long long bytesBefore = statsLocal()->bytesOut;
+            TRACE4(compute_end, conn->fd, nums[i], lens[i], computeNanos);
+            respondDigits(conn, digits[i], lens[i], NULL);
+            TRACE3(write_done, conn->fd, statsLocal()->bytesOut - bytesBefore,
+                   conn->acceptedAt != 0 ? traceNanos() - conn->acceptedAt : 0);
+            conn->batched = 0;
+            int handled = 0;
+            if (!slots[i].keep || !listening) {
+                finishConn(epollFd, conn);
+                continue;
+            }
+            nextRequest(conn, slots[i].headLen);
+            if (!serveBuffered(conn, ss, listening, &handled))
+                finishConn(epollFd, conn);
+            else
+                watchConn(epollFd, conn);
+        }
+    }
+}
+
+// out of descriptors (or memory) the listener stays readable with its queue intact, and the
+// level-triggered loop would spin on it. the listeners leave the event loop for a while instead.
+static void pauseAccepting(int epollFd, const acceptParams* ap) {
+    if (!atomic_flag_test_and_set(&acceptWarned))
+        fprintf(stderr, "[Warn] Cannot accept: %s, pausing for %d ms at a time.\n", strerror(errno), ACCEPT_PAUSE_MS);
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, ap->serverFd, NULL);
+    if (shardFd >= 0)
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, shardFd, NULL);
+    acceptPausedUntil = nowNanos() + ACCEPT_PAUSE_MS * 1000000L;
+}
+
+static void resumeAccepting(int epollFd, const acceptParams* ap) {
+    const unsigned events = EPOLLIN | (ap->ss->epollExclusive ? EPOLLEXCLUSIVE : 0);
+    struct epoll_event ev = { .events = events, .data.ptr = NULL };
+    struct epoll_event shard = { .events = events, .data.ptr = &shardTag };
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, ap->serverFd, &ev);
+    if (shardFd >= 0)
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, shardFd, &shard);
+    acceptPausedUntil = 0;
+}
+
+// registers a freshly accepted connection with the worker's event loop, -1 if none was queued.
+static int acceptFrom(int epollFd, int listenFd, const acceptParams* ap) {
+    // another worker may have taken it already.
+    const int acceptedSocket = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);  // the peer address is never used.
+    if (acceptedSocket < 0) {
+        switch (errno) {
+            case EINTR:
+            case ECONNABORTED:
+            // errors pending on the new connection, which is gone, the next one may be fine.
+            case EPROTO: case ENETDOWN: case ENOPROTOOPT: case EHOSTDOWN: case ENONET:
+            case EHOSTUNREACH: case EOPNOTSUPP: case ENETUNREACH:
+                return 0;
+            case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+                pauseAccepting(epollFd, ap);
+                return -1;
+            default:
+                return -1;  // EAGAIN: the queue is empty.
+        }
+    }
+    statsLocal()->accepted++;
+    TRACE1(accept, acceptedSocket);
+    connection* conn = connAcquire(acceptedSocket);
+    if (conn == NULL) {
+        close(acceptedSocket);
+        return 0;
+    }
+    conn->acceptedAt = TRACE_ENABLED(parse_done) || TRACE_ENABLED(write_done) ? traceNanos() : 0;
+    if (ap->ss->busyPollMicros > 0)
+        setsockopt(acceptedSocket, SOL_SOCKET, SO_BUSY_POLL, &ap->ss->busyPollMicros, sizeof(int));
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, acceptedSocket, &ev) < 0) {
+        close(acceptedSocket);
+        connRelease(conn);
+    } else {
+        openConns++;
+        conn->prev = NULL;
+        if ((conn->next = liveConns) != NULL)
+            liveConns->prev = conn;
+        liveConns = conn;
+    }
+    return 0;
+}
+
+// applies the accept-path options to a listening socket.
+static int tuneListener(int fd, const serverSettings* ss) {
+    if (ss->unixPath != NULL)
+        return 0;  // nothing below applies to a Unix domain socket.
+    // the kernel only queues the connection once its first bytes arrived,
+    // so a worker woken for it never finds an empty socket.
+    if (ss->deferAcceptSeconds > 0
+        && setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &ss->deferAcceptSeconds, sizeof(int)) < 0) {
+        perror("In setsockopt(TCP_DEFER_ACCEPT)");
+        return -1;
+    }
+    // lets returning clients send the request in the SYN.
+    if (ss->fastOpenQueue > 0
+        && setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &ss->fastOpenQueue, sizeof(int)) < 0) {
+        perror("In setsockopt(TCP_FASTOPEN)");
+        return -1;
+    }
+    // raising it above net.core.busy_read needs CAP_NET_ADMIN.
+    if (ss->busyPollMicros > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &ss->busyPollMicros, sizeof(int)) < 0) {
+        perror("In setsockopt(SO_BUSY_POLL)");
+        return -1;
+    }
+    return 0;
+}
+
+// pins the worker in "slot" to its cpu, keeps its pools on that cpu's node and opens its
+// listener shard. prefork processes interleave so their workers do not pile onto the first cpus.
+static void placeWorker(int epollFd, const serverSettings* ss, int slot) {
+    if (ss->cpuCount == 0) {
+        affinityUnpin();  // do not inherit the main thread's cpu.
+        return;
+    }
+    const int cpu = ss->cpus[(processSlot + slot * (ss->prefork ? ss->workerCount : 1)) % ss->cpuCount];
+    if (affinityPin(cpu) < 0) {
+        fprintf(stderr, "[Warn] Cannot pin a worker to cpu %d.\n", cpu);
+        return;
+    }
+    if (ss->numa)
+        poolBindNode(affinityCurrentNode());
+    if (ss->listenerShards && ss->unixPath == NULL) {
+        struct epoll_event ev = { .events = EPOLLIN | (ss->epollExclusive ? EPOLLEXCLUSIVE : 0), .data.ptr = &shardTag };
+        if ((shardFd = affinityShardListener(cpu, PORT, ss->backlog)) < 0 || tuneListener(shardFd, ss) < 0
+            || epoll_ctl(epollFd, EPOLL_CTL_ADD, shardFd, &ev) < 0)
+            fprintf(stderr, "[Warn] No listener shard for cpu %d, sharing the main listener.\n", cpu);
+    }
+}
+
+// closes the connections whose client took none of their output for "write_timeout_ms",
+// looked at about once a second while there are any. the socket's own buffers can hold
+// seconds' worth for a slow reader, so progress is whatever left them since the last look.
+static void dropStalled(int epollFd, const serverSettings* ss) {
+    const long now = nowNanos();
+    if (blockedConns == 0 || ss->writeTimeoutMs <= 0 || now - sweptAt < WRITE_SWEEP_MS * 1000000L)
+        return;
+    sweptAt = now;
+    for (connection* conn = liveConns; conn != NULL;) {
+        connection* next = conn->next;
+        int unsent;
+        if (conn->blocked && ioctl(conn->fd, SIOCOUTQ, &unsent) == 0 && unsent != conn->unsent) {
+            conn->unsent = unsent;
+            conn->blockedAt = now;
+        } else if (conn->blocked && now - conn->blockedAt > ss->writeTimeoutMs * 1000000L) {
+            statsLocal()->errors++;
+            closeConn(epollFd, conn);
+        }
+        conn = next;
+    }
+}
+
+// busy-poll mode: keeps asking for events without sleeping for up to "spinNanos",
+// so a request arriving meanwhile skips the wake-up latency, then blocks as usual
+// (for at most "timeoutMs", -1 without a limit).
+static int waitEvents(int epollFd, struct epoll_event* events, long spinNanos, int timeoutMs) {
+    if (spinNanos > 0) {
+        struct timespec spinFrom;
+        clock_gettime(CLOCK_MONOTONIC, &spinFrom);
+        do {
+            const int readyCount = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, 0);
+            if (readyCount != 0)
+                return readyCount;
+        } while (elapsedNanos(&spinFrom) < spinNanos);
+    }
+    return epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, timeoutMs);
+}
+
 noreturn void* acceptConn(void *arg) {
     acceptParams* ap = (acceptParams*) arg;
-    int acceptedSocket;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int epollFd = -1;
 
-    while (1) {
-        pthread_cleanup_push(renewThread, &acceptedSocket);
-            // extracts a request from the queue.
-            if ((acceptedSocket = accept(ap->serverFd, ap->addr, ap->addrLen)) < 0) {
-                perror("In accept");
+    pthread_cleanup_push(renewThread, &epollFd);
+        // every worker runs its own event loop over the shared listening socket. with
+        // EPOLLEXCLUSIVE a new connection wakes one of them rather than all.
+        struct epoll_event ev = { .events = EPOLLIN | (ap->ss->epollExclusive ? EPOLLEXCLUSIVE : 0), .data.ptr = NULL };
+        struct epoll_event wake = { .events = EPOLLIN | EPOLLET, .data.ptr = &wakeTag };
+        if ((epollFd = epoll_create1(0)) < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, ap->serverFd, &ev) < 0
+            || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wake) < 0) {
+            perror("In epoll setup");
+            pthread_exit(NULL);
+        }
+        int listening = 1;
+        int retiring = 0;
+        placeWorker(epollFd, ap->ss, autoscaleRegister());
+
+        while (1) {
+            // with degradation on, first see whether events queued up during the last wakeup.
+            int readyCount = degradeEnabled() ? epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, 0) : 0;
+            const int queued = readyCount > 0;
+            if (readyCount <= 0) {
+                int timeoutMs = blockedConns > 0 && ap->ss->writeTimeoutMs > 0 ? WRITE_SWEEP_MS : -1;
+                if (acceptPausedUntil != 0) {
+                    const long leftNs = acceptPausedUntil - nowNanos();
+                    const int resumeMs = leftNs > 0 ? (int) (leftNs / 1000000L) + 1 : 0;
+                    timeoutMs = timeoutMs < 0 || resumeMs < timeoutMs ? resumeMs : timeoutMs;
+                }
+                readyCount = waitEvents(epollFd, events, ap->ss->spinMicros * 1000, timeoutMs);
+            }
+            if (readyCount < 0) {
+                if (errno == EINTR)
+                    continue;
+                perror("In epoll_wait");
                 pthread_exit(NULL);
             }
+            struct timespec busyFrom;
+            clock_gettime(CLOCK_MONOTONIC, &busyFrom);
+            degradeWakeup(&busyFrom, queued);
+            for (int i = 0; i < readyCount; i++) {
+                connection* conn = events[i].data.ptr;
+                if (conn == (connection*) &wakeTag)
+                    continue;
+                if (conn == NULL || conn == (connection*) &shardTag) {
+                    // drain a burst of connections per wakeup instead of one per epoll_wait.
+                    const int listenFd = conn == NULL ? ap->serverFd : shardFd;
+                    for (int n = 0; n < ap->ss->acceptBatch && acceptFrom(epollFd, listenFd, ap) == 0; n++);
+                    continue;
+                }
+
+                if (conn->h2 != NULL) {
+                    // HTTP/2 keeps the connection for as many requests as the client sends.
+                    if ((conn->blocked ? h2Write(conn->h2) : h2Read(conn->h2)) < 0)
+                        closeConn(epollFd, conn);
+                    else
+                        watchConn(epollFd, conn);
+                    continue;
+                }
+
+                int handled = 0;
+                if (conn->blocked) {
+                    // the client took some of its output. once all of it is out, what it
+                    // pipelined meanwhile is answered.
+                    conn->blockedAt = nowNanos();
+                    const int flushed = flushOut(conn);
+                    if (flushed < 0 || (flushed > 0 && conn->closing))
+                        closeConn(epollFd, conn);
+                    else if (flushed > 0 && !serveBuffered(conn, ap->ss, listening, &handled))
+                        finishConn(epollFd, conn);
+                    else
+                        watchConn(epollFd, conn);
+                    continue;
+                }
+
+                // a request may arrive over several reads, keep what came and resume parsing.
+                // a keep-alive client may have pipelined more requests behind it, answered in turn.
+                const int fillResult = chainFill(&conn->in, conn->fd, ap->ss->maxHeaderBytes);
+                if (!serveBuffered(conn, ap->ss, listening, &handled)) {
+                    finishConn(epollFd, conn);
+                } else if (conn->batched) {
+                    // the flush answers it, and closes it if the client is gone.
+                    if (batchCount >= ap->ss->batch)
+                        flushBatch(epollFd, ap->ss, listening);
+                } else if (outputPending(conn)) {
+                    watchConn(epollFd, conn);  // the rest is read once the client took its answers.
+                } else if (handled > 0 && (fillResult == CHAIN_AGAIN || fillResult == CHAIN_LIMIT)) {
+                    continue;  // at the limit, the rest is still in the socket and epoll reports it again.
+                } else if (conn->h2 != NULL) {
+                    continue;
+                } else if (fillResult == CHAIN_LIMIT) {
+                    static const char tooLarge[] = "HTTP/1.1 431 Request Header Fields Too Large\r\n\r\n";
+                    respond(conn, tooLarge, sizeof(tooLarge) - 1);
+                    statsLocal()->errors++;
+                    finishConn(epollFd, conn);
+                } else if (fillResult != CHAIN_AGAIN) {
+                    if (fillResult == CHAIN_ERROR)
+                        statsLocal()->errors++;
+                    closeConn(epollFd, conn);
+                }
+            }
+            flushBatch(epollFd, ap->ss, listening);
+            dropStalled(epollFd, ap->ss);
+            if (acceptPausedUntil != 0 && nowNanos() >= acceptPausedUntil && listening)
+                resumeAccepting(epollFd, ap);
+            statsPublish();  // once per wakeup, not per request.
+            autoscaleBusy(elapsedNanos(&busyFrom));
 
-            // deal with HTTP request.
-            char reqBuf[HTTP_REQ_BUF];
-            bzero(reqBuf, HTTP_REQ_BUF);
-            const size_t receivedBytes = read(acceptedSocket, reqBuf, HTTP_REQ_BUF);
-            if (receivedBytes > 0) {
-                char resBuf[HTTP_RES_BUF];
-
-                // retrieve number from query.
-                pthread_mutex_lock(&mutex);
-                const int num = retrieveGETQueryIntValByKey(reqBuf, "num");
-                pthread_mutex_unlock(&mutex);
-
-                int fibResult = calcFibonacci(num);
-                // follow the format of the http response.
-                sprintf(resBuf, "HTTP/1.1 200 OK\r\n\r\n%d", fibResult);
-                write(acceptedSocket, resBuf, strlen(resBuf));
+            // after a handoff (or when the autoscaler shrinks the pool) only the connections
+            // already accepted are served, then the worker retires.
+            if (atomic_load(&draining) || retiring || (retiring = autoscaleShouldRetire())) {
+                if (listening) {
+                    h2GoAwayAll();  // HTTP/2 clients finish their streams and reconnect elsewhere.
+                    // idle keep-alive connections would hold the worker forever, their clients reconnect.
+                    for (connection* conn = liveConns; conn != NULL; conn = conn->next) {
+                        if (conn->h2 != NULL)
+                            watchConn(epollFd, conn);  // a GOAWAY the socket did not take yet.
+                        else if (conn->served > 0 && conn->in.total == 0 && !conn->blocked)
+                            shutdown(conn->fd, SHUT_RDWR);
+                    }
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, ap->serverFd, NULL);
+                    if (shardFd >= 0) {
+                        // closing a shard resets what is queued on it, so take that in first.
+                        epoll_ctl(epollFd, EPOLL_CTL_DEL, shardFd, NULL);
+                        while (acceptFrom(epollFd, shardFd, ap) == 0);
+                    }
+                    listening = 0;
+                }
+                if (openConns == 0)
+                    pthread_exit(NULL);
             }
-            close(acceptedSocket);
-        pthread_cleanup_pop(0);
+        }
+    pthread_cleanup_pop(0);
+}
+
+// samples the workers periodically and lets the autoscaler resize the pool.
+static void* scaleThread(void* arg) {
+    const serverSettings* ss = arg;
+    const struct timespec interval = { ss->scaleIntervalMs / 1000, (ss->scaleIntervalMs % 1000) * 1000000L };
+    while (!atomic_load(&draining)) {
+        nanosleep(&interval, NULL);
+        const int delta = autoscaleStep();
+        if (delta > 0) {
+            pthread_mutex_lock(&mutex);
+            pthread_cond_signal(&cond);  // spawn one more.
+            pthread_mutex_unlock(&mutex);
+        } else if (delta < 0) {
+            const unsigned long long one = 1;
+            write(wakeFd, &one, sizeof(one));  // one of the woken workers claims the retirement.
+        }
     }
+    return NULL;
 }
 
-int main(int argc, const char* argv[]) {
-    // initialize the server setup.
-    serverSettings ss = { .threadCount = 4 };
-    setupServerSettings(argc, argv, &ss);
+static volatile sig_atomic_t reloadRequested = 0;
 
-    int serverFd;
-    sockaddr_in address;
-    int addrLen = sizeof(address);
+static void onReloadSignal(int sig) {
+    (void) sig;
+    reloadRequested = 1;
+}
 
-    // establish a socket.
-    if ((serverFd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("In socket creation");
-        exit(EXIT_FAILURE);
-    }
+// stops accepting and wakes every worker so it notices, async-signal-safe.
+static void beginDrain(void) {
+    const unsigned long long one = 1;
+    atomic_store(&draining, 1);
+    write(wakeFd, &one, sizeof(one));
+}
 
-    bzero(&address, addrLen);
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;  // -> 0.0.0.0.
-    address.sin_port = htons(PORT);
+static void onDrainSignal(int sig) {
+    (void) sig;
+    beginDrain();
+}
 
-    // assigns specified address to the socket.
-    if (bind(serverFd, (sockaddr*) &address, sizeof(address)) < 0) {
-        perror("In bind");
+// keeps "threadCount" workers alive, replacing any that exit,
+// until a drain has let all of them finish (or the drain timed out).
+static noreturn void runWorkers(acceptParams* ap) {
+    time_t drainDeadline = 0;
+    if ((wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        perror("In eventfd");
         exit(EXIT_FAILURE);
     }
-
-    // mark the socket as a passive socket.
-    if (listen(serverFd, MAX_LISTEN_CONN) < 0) {
-        perror("In listen");
-        exit(EXIT_FAILURE);
+    // per process, the watcher thread would not survive a fork.
+    if (ap->ss->staticRoot != NULL && staticInit(ap->ss->staticRoot) < 0)
+        fprintf(stderr, "[Warn] Static root \"%s\" is unavailable.\n", ap->ss->staticRoot);
+    autoscaleInit(ap->ss, ap->serverFd);
+    if (autoscaleEnabled()) {
+        pthread_t threadId;
+        pthread_create(&threadId, NULL, scaleThread, (void*) ap->ss);
     }
-    printf("\nServer is now listening at port %d:\n\n", PORT);
-
-    // main loop.
     while (1) {
+        // the main thread loads the plugin, so workers never wait for it.
+        if (reloadRequested) {
+            reloadRequested = 0;
+            if (ap->ss->plugin != NULL)
+                pluginLoad(ap->ss->plugin);
+        }
         pthread_mutex_lock(&mutex);
-        while (threadCounter >= ss.threadCount)
-            pthread_cond_wait(&cond, &mutex);
+        while ((threadCounter >= autoscaleTarget() && !reloadRequested) || atomic_load(&draining)) {
+            if (atomic_load(&draining)) {
+                if (drainDeadline == 0)
+                    drainDeadline = time(NULL) + HANDOFF_DRAIN_SECONDS;
+                if (threadCounter == 0 || time(NULL) >= drainDeadline) {
+                    printf("[Info] Process %d drained, exiting.\n", getpid());
+                    exit(EXIT_SUCCESS);
+                }
+            }
+            // a drain started from a signal handler cannot signal the condition, so poll for it.
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += 1;
+            pthread_cond_timedwait(&cond, &mutex, &until);
+        }
         pthread_mutex_unlock(&mutex);
+        if (threadCounter >= autoscaleTarget())
+            continue;  // woken for a reload.
 
         // create new thread to handle the request.
         pthread_t threadId;
-        acceptParams ap = { serverFd, (sockaddr*) &address, (socklen_t*) &addrLen };
-        pthread_create(&threadId, NULL, acceptConn, &ap);
+        pthread_create(&threadId, NULL, acceptConn, ap);
         atomic_fetch_add(&threadCounter, 1);
         printf("[Info] Thread Created: No.%d\n", threadCounter);
     }
+}
+
+static int controlFd = -1;
+static int handoffFds[HANDOFF_MAX_FDS];
+static int handoffCount = 0;
+
+static volatile sig_atomic_t dumpRequested = 0;
+static volatile sig_atomic_t stopRequested = 0;
+static volatile sig_atomic_t drainRequested = 0;
+
+static void onSupervisorSignal(int sig) {
+    if (sig == SIGUSR1)
+        dumpRequested = 1;
+    else if (sig == SIGUSR2)
+        drainRequested = 1;
+    else if (sig == SIGHUP)
+        reloadRequested = 1;
+    else
+        stopRequested = 1;
+}
+
+static pid_t spawnWorker(int slot, acceptParams* ap) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGUSR1, SIG_IGN);
+        signal(SIGUSR2, onDrainSignal);
+        signal(SIGHUP, onReloadSignal);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        if (controlFd >= 0)
+            close(controlFd);  // only the supervisor answers successors.
+        processSlot = slot;
+        statsBindSlot(slot);
+        runWorkers(ap);
+    }
+    if (pid < 0)
+        perror("In fork");
+    return pid;
+}
+
+// prefork mode: worker processes share the listening socket, the supervisor
+// restarts those that die and prints their shared statistics on SIGUSR1.
+static int superviseWorkers(acceptParams* ap) {
+    const int workerCount = ap->ss->workerCount;
+    pid_t pids[workerCount];
+    time_t spawnedAt[workerCount];
+
+    struct sigaction sa = { .sa_handler = onSupervisorSignal };  // no SA_RESTART, waitpid must return.
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGUSR2, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (int i = 0; i < workerCount; i++) {
+        pids[i] = spawnWorker(i, ap);
+        spawnedAt[i] = time(NULL);
+    }
+    printf("[Info] Supervisor %d started %d workers.\n", getpid(), workerCount);
+
+    int alive = workerCount;
+    while (!stopRequested && alive > 0) {
+        int status;
+        const pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno != EINTR)
+                break;
+            if (dumpRequested) {
+                dumpRequested = 0;
+                statsDump(stdout);
+            }
+            if (reloadRequested) {
+                // reload here too, so workers restarted later fork with the new plugin.
+                reloadRequested = 0;
+                if (ap->ss->plugin != NULL && pluginLoad(ap->ss->plugin) == 0)
+                    for (int i = 0; i < workerCount; i++)
+                        kill(pids[i], SIGHUP);
+            }
+            if (drainRequested == 1) {
+                // the socket now belongs to a successor, let the workers finish what they hold.
+                drainRequested = 2;
+                for (int i = 0; i < workerCount; i++)
+                    kill(pids[i], SIGUSR2);
+            }
+            continue;
+        }
+        for (int i = 0; i < workerCount; i++) {
+            if (pids[i] != pid)
+                continue;
+            if (drainRequested) {
+                pids[i] = 0;
+                alive--;
+                continue;
+            }
+            if (WIFSIGNALED(status))
+                fprintf(stderr, "[Warn] Worker %d (pid %d) killed by signal %d, restarting.\n", i, pid, WTERMSIG(status));
+            else
+                fprintf(stderr, "[Warn] Worker %d (pid %d) exited with %d, restarting.\n", i, pid, WEXITSTATUS(status));
+            // back off a little when a worker keeps dying right after start.
+            if (time(NULL) - spawnedAt[i] < 1)
+                sleep(1);
+            statsAddRestart();
+            pids[i] = spawnWorker(i, ap);
+            spawnedAt[i] = time(NULL);
+        }
+    }
+
+    for (int i = 0; i < workerCount; i++)
+        if (pids[i] > 0)
+            kill(pids[i], SIGTERM);
+    while (wait(NULL) > 0);
+    statsDump(stdout);
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+// waits on the control socket for a successor, hands it the listening socket (and the memo),
+// then lets this process drain.
+static void* handoffThread(void* arg) {
+    const serverSettings* ss = arg;
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);  // signals belong to the main thread.
+    while (handoffServe(controlFd, handoffFds, handoffCount) < 0);
+    close(controlFd);
+    printf("[Info] Listening socket handed off, draining.\n");
+    fflush(stdout);
+    if (ss->prefork)
+        kill(getpid(), SIGUSR2);  // the supervisor drains its workers.
+    else
+        beginDrain();
+    pthread_mutex_lock(&mutex);
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+int main(int argc, const char* argv[]) {
+    // initialize the server setup.
+    serverSettings ss = {
+        .threadCount = 4, .hugePages = 0, .maxHeaderBytes = HTTP_MAX_HEADER_BYTES, .simd = NULL,
+        .prefork = 0, .workerCount = (int) sysconf(_SC_NPROCESSORS_ONLN), .memo = "anon",
+        .store = NULL, .storeMinMicros = STORE_MIN_MICROS, .handoff = NULL,
+        .minThreads = 0, .maxThreads = 0, .scaleIntervalMs = SCALE_INTERVAL_MS,
+        .cpuCount = 0, .mainCpu = -1, .numa = 0, .listenerShards = 0,
+        .busyPollMicros = 0, .spinMicros = 0, .backlog = MAX_LISTEN_CONN, .deferAcceptSeconds = 0,
+        .fastOpenQueue = 0, .acceptBatch = ACCEPT_BATCH, .epollExclusive = 0,
+        .h2 = 1, .h2MaxStreams = H2_DEFAULT_STREAMS, .keepAliveRequests = KEEPALIVE_REQUESTS, .batch = 0,
+        .maxNum = MAX_NUM, .computeThreads = 0, .degradeQueueMicros = 0, .degradeTolerance = DEGRADE_TOLERANCE,
+        .writeTimeoutMs = WRITE_TIMEOUT_MS
+    };
+    setupServerSettings(argc, argv, &ss);
+    if (ss.cpuCount < 0) {
+        fprintf(stderr, "[Error] \"cpus\" takes a list such as \"0-3,8\" of at most %d cpus, each below %d.\n",
+                MAX_PINNED_CPUS, CPU_SETSIZE);
+        exit(EXIT_FAILURE);
+    }
+    if (ss.acceptBatch < 1)
+        ss.acceptBatch = 1;
+    if (ss.h2MaxStreams < 1 || ss.h2MaxStreams > H2_MAX_STREAMS)
+        ss.h2MaxStreams = ss.h2MaxStreams < 1 ? 1 : H2_MAX_STREAMS;
+    if (ss.batch < 0 || ss.batch > BATCH_MAX)
+        ss.batch = ss.batch < 0 ? 0 : BATCH_MAX;
+    // threads inherit the main thread's cpu, workers re-pin (or unpin) themselves.
+    affinityInit();
+    if (ss.mainCpu >= 0 && affinityPin(ss.mainCpu) < 0)
+        fprintf(stderr, "[Warn] Cannot pin the main thread to cpu %d.\n", ss.mainCpu);
+    // spinning loops sharing a core only take turns burning it.
+    const int maxLoops = ss.maxThreads > ss.threadCount ? ss.maxThreads : ss.threadCount;
+    if (ss.spinMicros > 0 && ss.cpuCount < maxLoops * (ss.prefork ? ss.workerCount : 1))
+        fprintf(stderr, "[Warn] spin_us without a dedicated cpu per event loop, list more cpus.\n");
+    poolInit((ss.hugePages ? POOL_HUGEPAGES : 0) | (ss.numa ? POOL_NUMA : 0));
+    scanInit();
+    if (ss.simd != NULL && scanSelect(ss.simd) < 0)
+        fprintf(stderr, "[Warn] SIMD kernel \"%s\" is not supported, using %s.\n", ss.simd, scanImplName());
+    batchInit();
+    if (ss.batch > 0)
+        printf("[Info] Micro-batching up to %d Fibonacci requests with the %s kernel.\n", ss.batch, batchImplName());
+    if (ss.degradeQueueMicros > 0)
+        printf("[Info] Estimating uncached Fibonacci values past %ld us of queueing, within a relative error of %.1e.\n",
+               ss.degradeQueueMicros, ss.degradeTolerance);
+    if (statsInit(ss.prefork ? ss.workerCount : 1) < 0) {
+        perror("In statsInit");
+        exit(EXIT_FAILURE);
+    }
+    statsBindSlot(0);
+
+    // a running server on the control path hands over its listening socket and memo.
+    int inherited[HANDOFF_MAX_FDS];
+    const int inheritedCount = ss.handoff != NULL ? handoffReceive(ss.handoff, inherited, HANDOFF_MAX_FDS) : -1;
+
+    if (inheritedCount >= 2 && memoAttach(inherited[1]) == 0)
+        printf("[Info] Fibonacci memo taken over from the previous process.\n");
+    else if (strcmp(ss.memo, "off") != 0 && memoInit(strcmp(ss.memo, "anon") == 0 ? NULL : ss.memo) < 0)
+        fprintf(stderr, "[Warn] Fibonacci memo \"%s\" is unavailable, computing every request.\n", ss.memo);
+    if (ss.store != NULL) {
+        // map the results of earlier runs before accepting anything, so they are served warm.
+        if (storeOpen(ss.store) < 0)
+            fprintf(stderr, "[Warn] Result store \"%s\" is unavailable.\n", ss.store);
+        else
+            printf("[Info] Result store \"%s\" loaded %zu values.\n", ss.store, storeCount());
+    }
+    engineInit(&ss);
+    if (ss.capture != NULL && captureOpen(ss.capture) < 0)
+        fprintf(stderr, "[Warn] Capture file \"%s\" is unavailable.\n", ss.capture);
+    if (ss.plugin != NULL && pluginLoad(ss.plugin) < 0)
+        fprintf(stderr, "[Warn] Using the built-in Fibonacci kernel.\n");
+    signal(SIGHUP, onReloadSignal);  // reloads the plugin.
+    signal(SIGPIPE, SIG_IGN);  // a client that leaves with pipelined answers unread must not kill the server.
+
+    int serverFd;
+    sockaddr_in address;
+    int addrLen = sizeof(address);
+    bzero(&address, addrLen);
+
+    if (inheritedCount >= 1) {
+        // already bound and listening, queued connections are still in its backlog.
+        serverFd = inherited[0];
+        printf("\nServer took over the listening socket from the previous process:\n\n");
+    } else if (ss.unixPath != NULL) {
+        // same pipeline over a Unix domain socket, for clients on the same host.
+        sockaddr_un unixAddress = { .sun_family = AF_UNIX };
+        if (strlen(ss.unixPath) >= sizeof(unixAddress.sun_path)) {
+            fprintf(stderr, "[Warn] Socket path \"%s\" is too long.\n", ss.unixPath);
+            exit(EXIT_FAILURE);
+        }
+        strcpy(unixAddress.sun_path, ss.unixPath);
+        if ((serverFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
+            perror("In socket creation");
+            exit(EXIT_FAILURE);
+        }
+        unlink(ss.unixPath);  // a stale socket file from a cold restart.
+        if (bind(serverFd, (sockaddr*) &unixAddress, sizeof(unixAddress)) < 0) {
+            perror("In bind");
+            exit(EXIT_FAILURE);
+        }
+        if (listen(serverFd, ss.backlog) < 0) {
+            perror("In listen");
+            exit(EXIT_FAILURE);
+        }
+        printf("\nServer is now listening at unix:%s:\n\n", ss.unixPath);
+    } else {
+        // establish a socket, non-blocking since all workers race to accept from it.
+        if ((serverFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) == 0) {
+            perror("In socket creation");
+            exit(EXIT_FAILURE);
+        }
+        // a cold restart must not wait for the previous process's TIME_WAIT connections.
+        const int reuse = 1;
+        setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        // the workers' listener shards join this socket's port group.
+        if (ss.listenerShards)
+            setsockopt(serverFd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;  // -> 0.0.0.0.
+        address.sin_port = htons(PORT);
+
+        // assigns specified address to the socket.
+        if (bind(serverFd, (sockaddr*) &address, sizeof(address)) < 0) {
+            perror("In bind");
+            exit(EXIT_FAILURE);
+        }
+
+        // mark the socket as a passive socket.
+        if (listen(serverFd, ss.backlog) < 0) {
+            perror("In listen");
+            exit(EXIT_FAILURE);
+        }
+        printf("\nServer is now listening at port %d:\n\n", PORT);
+    }
+    // an inherited socket takes this generation's options (listen again only resizes the backlog).
+    if (inheritedCount >= 1)
+        listen(serverFd, ss.backlog);
+    tuneListener(serverFd, &ss);
+    fflush(stdout);  // children must not inherit buffered output.
+
+    // be ready to hand everything over to the next binary.
+    if (ss.handoff != NULL) {
+        if ((controlFd = handoffListen(ss.handoff)) < 0) {
+            perror("In handoffListen");
+        } else {
+            handoffFds[handoffCount++] = serverFd;
+            if (memoFd() >= 0)
+                handoffFds[handoffCount++] = memoFd();
+            pthread_t threadId;
+            pthread_create(&threadId, NULL, handoffThread, &ss);
+        }
+    }
+
+    acceptParams ap = { serverFd, &ss };
+    if (ss.prefork)
+        return superviseWorkers(&ap);
+    // a stop finishes the connections in flight and exits normally (which also writes
+    // the profile of an instrumented build).
+    signal(SIGTERM, onDrainSignal);
+    signal(SIGINT, onDrainSignal);
+    runWorkers(&ap);
+}
@@ -0,0 +1,44 @@
+# compares two "metric median spread unit better" files, the baseline first.
+# a metric only counts as changed when it moved by more than the larger of "tolerance"
+# (relative, 10% by default) and three standard deviations of the difference, estimated
+# from both runs' spreads (a median absolute deviation is about 1/1.4826 of one), so a
+# noisy metric needs a bigger move before it is reported. exits 1 if anything regressed.
+#
+# usage: awk [-v tolerance=0.10] -f tools/bench-compare.awk <baseline> <results>
+BEGIN {
+    FS = "\t"
+    if (tolerance == "")
+        tolerance = 0.10
+}
+/^#/ || NF < 5 { next }
+FNR == NR {
+    base[$1] = $2
+    baseSpread[$1] = $3
+    next
+}
+{
+    seen[$1] = 1
+    if (!($1 in base)) {
+        printf "%-28s %12s %12.3f %-6s new\n", $1, "-", $2, $4
+        next
+    }
+    if (base[$1] <= 0)
+        next
+    change = ($2 - base[$1]) / base[$1]
+    worse = $5 == "higher" ? -change : change
+    noise = 3 * 1.4826 * sqrt(baseSpread[$1] ^ 2 + $3 ^ 2)
+    limit = tolerance > noise ? tolerance : noise
+    verdict = worse > limit ? "REGRESSED" : worse < -limit ? "improved" : "ok"
+    if (verdict == "REGRESSED")
+        regressions++
+    printf "%-28s %12.3f %12.3f %-6s %+7.1f%% (limit %4.1f%%) %s\n", $1, base[$1], $2, $4, 100 * change, 100 * limit, verdict
+}
+END {
+    for (m in base)
+        if (!(m in seen))
+            printf "%-28s %12.3f %12s %-6s missing\n", m, base[m], "-", ""
+    if (regressions > 0) {
+        printf "%d metric(s) regressed.\n", regressions
+        exit 1
+    }
+}
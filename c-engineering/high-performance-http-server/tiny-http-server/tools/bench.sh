@@ -0,0 +1,60 @@
+#!/bin/sh
+# runs the benchmark suite and compares it with the committed baseline:
+#   1. "suite-bench" times the parser, router, compute kernels and formatting in-process;
+#   2. the Release http-server answers benchmark/corpus/workload.http from "load-bench"
+#      at each concurrency in BENCH_CONNECTIONS, BENCH_RUNS times each;
+#   3. the results, one "metric median spread unit better" line per metric, go to
+#      <build dir>/bench-results.tsv and "bench-compare.awk" checks them against
+#      benchmark/baseline.tsv. the script fails when a metric regressed beyond its noise.
+# with "update" as the last argument the results replace the baseline instead.
+#
+# usage: tools/bench.sh <source dir> <build dir> [update]
+set -e
+SRC=$(cd "$1" && pwd)
+OUT=$2
+BASELINE=$SRC/benchmark/baseline.tsv
+RESULTS=$OUT/bench-results.tsv
+CORPUS=$SRC/benchmark/corpus/workload.http
+CONNECTIONS=${BENCH_CONNECTIONS:-1 8 64}
+RUNS=${BENCH_RUNS:-5}
+SECONDS_PER_RUN=${BENCH_SECONDS:-2}
+PORT=8080
+
+# median and spread (median absolute deviation over median) of the numbers on stdin.
+summarise() {
+    values=$(sort -g)
+    median=$(echo "$values" | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }')
+    echo "$values" | awk -v m="$median" '{ print ($1 > m ? $1 - m : m - $1) }' | sort -g \
+        | awk -v m="$median" '{ d[NR] = $1 } END { printf "%.3f\t%.4f", m, (m > 0 ? d[int((NR + 1) / 2)] / m : 0) }'
+}
+
+printf "# metric\tmedian\tspread\tunit\tbetter\n" >"$RESULTS"
+echo "== in-process"
+"$OUT/suite-bench" "$SRC/benchmark/corpus/requests.http" "$OUT/libfib-iterative.so" | grep "$(printf "\t")" | tee -a "$RESULTS"
+
+echo "== end to end"
+"$OUT/http-server" thread_count=4 >/dev/null &
+pid=$!
+trap 'kill -TERM $pid 2>/dev/null || true' EXIT
+sleep 1
+for c in $CONNECTIONS; do
+    runs=$OUT/bench-c$c.txt
+    : >"$runs"
+    for r in $(seq "$RUNS"); do
+        "$OUT/load-bench" $PORT "$CORPUS" "$c" "$SECONDS_PER_RUN" >>"$runs"
+    done
+    printf "e2e.c%s.req_per_s\t%s\treq/s\thigher\n" "$c" "$(awk '/^requests:/ { print $(NF - 1) }' "$runs" | summarise)" \
+        | tee -a "$RESULTS"
+    printf "e2e.c%s.p50\t%s\tus\tlower\n" "$c" "$(awk '/^latency/ { print $4 }' "$runs" | summarise)" | tee -a "$RESULTS"
+    printf "e2e.c%s.p99\t%s\tus\tlower\n" "$c" "$(awk '/^latency/ { print $8 }' "$runs" | summarise)" | tee -a "$RESULTS"
+done
+
+if [ "$3" = "update" ]; then
+    cp "$RESULTS" "$BASELINE"
+    echo "== baseline updated: $BASELINE"
+elif [ -f "$BASELINE" ]; then
+    echo "== against $BASELINE"
+    awk -v tolerance="${BENCH_TOLERANCE:-0.10}" -f "$SRC/tools/bench-compare.awk" "$BASELINE" "$RESULTS"
+else
+    echo "== no baseline yet, run the bench-baseline target to record one"
+fi
@@ -0,0 +1,44 @@
+#!/bin/sh
+# builds the profile-guided, link-time optimised http-server:
+#   1. an instrumented build (-DPGO=generate) serves the recorded workload
+#      in benchmark/corpus/workload.http, writing its profile on exit;
+#   2. the same build directory is rebuilt with -DPGO=use (and LTO);
+#   3. the plain Release build and the optimised one are compared in req/s.
+#
+# usage: tools/pgo-build.sh <source dir> <build dir> [plain http-server] [extra cmake args...]
+set -e
+SRC=$(cd "$1" && pwd)
+OUT=$2
+PLAIN=$3
+if [ $# -ge 3 ]; then shift 3; else shift $#; fi
+CORPUS=$SRC/benchmark/corpus/workload.http
+CONNECTIONS=${PGO_CONNECTIONS:-8}
+SECONDS_PER_RUN=${PGO_SECONDS:-10}
+PORT=8080
+
+# serves the workload with the server binary $1 and prints the load-bench summary.
+serve() {
+    "$1" thread_count=4 >/dev/null &
+    pid=$!
+    sleep 1
+    "$OUT/load-bench" $PORT "$CORPUS" "$CONNECTIONS" "$2"
+    kill -TERM $pid
+    wait $pid || true
+}
+
+cmake -S "$SRC" -B "$OUT" -DPGO=generate "$@" >/dev/null
+cmake --build "$OUT" --clean-first -j"$(nproc)" --target http-server load-bench >/dev/null
+find "$OUT" -name '*.gcda' -delete
+echo "== training the instrumented build"
+serve "$OUT/http-server" "$SECONDS_PER_RUN"
+
+cmake -S "$SRC" -B "$OUT" -DPGO=use "$@" >/dev/null
+cmake --build "$OUT" --clean-first -j"$(nproc)" --target http-server load-bench >/dev/null
+echo "== PGO + LTO build: $OUT/http-server"
+
+if [ -n "$PLAIN" ]; then
+    echo "== plain Release"
+    serve "$PLAIN" "$SECONDS_PER_RUN"
+    echo "== PGO + LTO"
+    serve "$OUT/http-server" "$SECONDS_PER_RUN"
+fi
@@ -0,0 +1,180 @@
+//
+// Created by fufeng on 2024/2/2.
+//
+// reads the route table ("libs/routes.def") and writes "routeDispatch", a function that finds
+// a route without comparing strings: it switches on the path length, then on the byte (or pair
+// of bytes) that differs between all routes of that length, and finally checks the one candidate
+// left with integer compares of 8-byte words. for dense cases the compiler turns both switches
+// into jump tables, see the analysis in "unitc/c_statement.c". paths no exact route matched are
+// then checked against the prefix routes, also word by word.
+//
+// usage: routegen <routes.def> <routes_gen.h>
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ROUTES 256
+#define MAX_PATH 256
+
+typedef struct {
+    char id[64];
+    char path[MAX_PATH];
+    size_t len;
+    int prefix;
+} route;
+
+static route routes[MAX_ROUTES];
+static int routeCount = 0;
+
+static int loadRoutes(const char* defPath) {
+    FILE* fp = fopen(defPath, "r");
+    if (fp == NULL)
+        return -1;
+    char line[512];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        route* r = &routes[routeCount];
+        size_t skip;
+        if (strncmp(line, "ROUTE(", 6) == 0)
+            r->prefix = 0, skip = 6;
+        else if (strncmp(line, "ROUTE_PREFIX(", 13) == 0)
+            r->prefix = 1, skip = 13;
+        else
+            continue;
+        const char* quote = strchr(line, '"');
+        const char* endQuote = quote == NULL ? NULL : strchr(quote + 1, '"');
+        if (sscanf(line + skip, " %63[A-Za-z0-9_]", r->id) != 1 || endQuote == NULL
+            || endQuote - quote - 1 == 0 || endQuote - quote - 1 >= MAX_PATH) {
+            fprintf(stderr, "routegen: malformed route: %s", line);
+            fclose(fp);
+            return -1;
+        }
+        r->len = endQuote - quote - 1;
+        memcpy(r->path, quote + 1, r->len);
+        r->path[r->len] = '\0';
+        for (int i = 0; i < routeCount; i++) {
+            if (strcmp(routes[i].path, r->path) == 0 && routes[i].prefix == r->prefix) {
+                fprintf(stderr, "routegen: \"%s\" is declared twice.\n", r->path);
+                fclose(fp);
+                return -1;
+            }
+        }
+        if (++routeCount == MAX_ROUTES)
+            break;
+    }
+    fclose(fp);
+    return routeCount;
+}
+
+// the key routes of one length are told apart by: one byte, or two bytes packed together.
+static unsigned keyOf(const route* r, int first, int second) {
+    const unsigned char* p = (const unsigned char*) r->path;
+    return second < 0 ? p[first] : (unsigned) p[first] << 8 | p[second];
+}
+
+static int keysDistinct(route** group, int count, int first, int second) {
+    for (int i = 0; i < count; i++)
+        for (int j = i + 1; j < count; j++)
+            if (keyOf(group[i], first, second) == keyOf(group[j], first, second))
+                return 0;
+    return 1;
+}
+
+#define MISS "routePrefixDispatch(p, len)"
+
+static void writeWords(FILE* out, const route* r) {
+    for (size_t off = 0; off < r->len; off += 8) {
+        const size_t n = r->len - off < 8 ? r->len - off : 8;
+        uint64_t word = 0;
+        memcpy(&word, r->path + off, n);
+        fprintf(out, "%srouteWord(p + %zu, %zu) == 0x%016llxULL", off == 0 ? "" : " && ", off, n, (unsigned long long) word);
+    }
+}
+
+// the candidate is only accepted if every word of the path matches.
+static void writeCheck(FILE* out, const route* r, const char* indent) {
+    fprintf(out, "%sreturn ", indent);
+    writeWords(out, r);
+    fprintf(out, " ? %s : " MISS ";  // \"%s\"\n", r->id, r->path);
+}
+
+// longest prefixes first, so "/static/img/" wins over "/static/".
+static void writePrefixes(FILE* out) {
+    fprintf(out, "static routeId routePrefixDispatch(const char* p, size_t len) {\n");
+    for (size_t len = MAX_PATH - 1; len > 0; len--) {
+        for (int i = 0; i < routeCount; i++) {
+            if (!routes[i].prefix || routes[i].len != len)
+                continue;
+            fprintf(out, "    if (len >= %zu && ", len);
+            writeWords(out, &routes[i]);
+            fprintf(out, ")  // \"%s\"\n        return %s;\n", routes[i].path, routes[i].id);
+        }
+    }
+    fprintf(out, "    (void) p;\n    (void) len;\n    return ROUTE_NONE;\n}\n\n");
+}
+
+static int writeGroup(FILE* out, route** group, int count, size_t len) {
+    fprintf(out, "        case %zu:\n", len);
+    if (count == 1) {
+        writeCheck(out, group[0], "            ");
+        return 0;
+    }
+    int first = -1, second = -1;
+    for (int i = 0; i < (int) len && first < 0; i++)
+        if (keysDistinct(group, count, i, -1))
+            first = i;
+    for (int i = 0; i < (int) len && first < 0; i++)
+        for (int j = i + 1; j < (int) len && first < 0; j++)
+            if (keysDistinct(group, count, i, j))
+                first = i, second = j;
+    if (first < 0) {
+        fprintf(stderr, "routegen: no one or two bytes tell the routes of length %zu apart.\n", len);
+        return -1;
+    }
+    if (second < 0)
+        fprintf(out, "            switch ((unsigned char) p[%d]) {\n", first);
+    else
+        fprintf(out, "            switch ((unsigned) (unsigned char) p[%d] << 8 | (unsigned char) p[%d]) {\n", first, second);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "                case 0x%x:\n", keyOf(group[i], first, second));
+        writeCheck(out, group[i], "                    ");
+    }
+    fprintf(out, "                default:\n                    return " MISS ";\n            }\n");
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: routegen <routes.def> <routes_gen.h>\n");
+        return EXIT_FAILURE;
+    }
+    if (loadRoutes(argv[1]) <= 0) {
+        fprintf(stderr, "routegen: no routes in \"%s\".\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    FILE* out = fopen(argv[2], "w");
+    if (out == NULL) {
+        perror("routegen");
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "// generated by routegen from routes.def, do not edit.\n");
+    fprintf(out, "// the word constants are in the byte order of the machine that built it.\n");
+    writePrefixes(out);
+    fprintf(out, "static routeId routeDispatch(const char* p, size_t len) {\n    switch (len) {\n");
+    int status = EXIT_SUCCESS;
+    for (size_t len = 1; len < MAX_PATH; len++) {
+        route* group[MAX_ROUTES];
+        int count = 0;
+        for (int i = 0; i < routeCount; i++)
+            if (routes[i].len == len && !routes[i].prefix)
+                group[count++] = &routes[i];
+        if (count > 0 && writeGroup(out, group, count, len) < 0)
+            status = EXIT_FAILURE;
+    }
+    fprintf(out, "        default:\n            return " MISS ";\n    }\n}\n");
+    fclose(out);
+    if (status != EXIT_SUCCESS)
+        remove(argv[2]);
+    return status;
+}